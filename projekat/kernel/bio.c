@@ -1,9 +1,27 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
-// cached copies of disk block contents.  Caching disk blocks
-// in memory reduces the number of disk reads and also provides
-// a synchronization point for disk blocks used by multiple processes.
+// The buffer cache is a set of buf structures holding cached
+// copies of disk block contents.  Caching disk blocks in memory
+// reduces the number of disk reads and also provides a
+// synchronization point for disk blocks used by multiple processes.
+//
+// Buffers are found through a hash table keyed by (dev, blockno).
+// Each bucket has its own lock, which protects the bucket's chain
+// and the refcnt of the buffers on it, so lookups of different
+// blocks don't contend.  Unused buffers (refcnt 0) are also kept
+// on a free list in least recently used order, under freelock.
+// Only a miss takes bcache.lock, which serializes recycling: as
+// misses are the only way a buffer changes identity, a block
+// that isn't cached when the recycler looks stays uncached until
+// it is done.  Lock order: bcache.lock, bucket lock, freelock.
+//
+// The cache grows and shrinks with free memory.  The data of
+// PGSIZE/BSIZE neighbouring buffers lives in one page from
+// kalloc(); a miss adds a page of buffers while the cache is
+// below its limit and more than BMINFREE pages are free, and
+// gives one back when free memory is below that.  kalloc()
+// also takes pages back through breclaim() when it runs out.
+// The first NBUF buffers are always there.
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
@@ -21,74 +39,324 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "stat.h"
 
-struct {
+#if BSIZE % 512 || BSIZE > PGSIZE
+#error "BSIZE must be a multiple of 512 no larger than PGSIZE"
+#endif
+
+#define NBUCKET 251
+#define BPP (PGSIZE/BSIZE)             // buffers per data page
+#define NBUFMIN ((NBUF+BPP-1)/BPP*BPP) // buffers that are never freed
+
+struct bucket {
 	struct spinlock lock;
-	struct buf buf[NBUF];
+	struct buf *head;       // chain through hnext
+};
+
+struct {
+	struct spinlock lock;   // serializes recycling, growing and shrinking
+	struct buf buf[NBUFMAX];
+	struct bucket bucket[NBUCKET];
+	int nbuf;               // buffers with data, in groups of BPP
+	int maxbuf;             // limit on nbuf
+
+	// Free list of unused buffers, through prev/next.
+	// free.next is least recently used.
+	struct spinlock freelock;
+	struct buf free;
 
-	// Linked list of all buffers, through prev/next.
-	// head.next is most recently used.
-	struct buf head;
+	uint hits;
+	uint misses;
+	uint evictions;
 } bcache;
 
+static void bdone(struct buf*);
+
+static struct bucket*
+bhash(uint dev, uint blockno)
+{
+	return &bcache.bucket[(dev*67 + blockno) % NBUCKET];
+}
+
+// Add b to the free list, as the most recently used buffer
+// if mru is set and as the least recently used one otherwise.
+// Caller must hold freelock.
+static void
+freepush(struct buf *b, int mru)
+{
+	struct buf *next;
+
+	next = mru ? &bcache.free : bcache.free.next;
+	b->prev = next->prev;
+	b->next = next;
+	next->prev->next = b;
+	next->prev = b;
+}
+
+// Remove b from the free list.  Caller must hold freelock.
+static void
+freeremove(struct buf *b)
+{
+	b->next->prev = b->prev;
+	b->prev->next = b->next;
+}
+
+// Give a page of data to the BPP buffers starting at g, which
+// hold no block yet.  Caller must hold bcache.lock, unless
+// called from binit().  Returns 0, or -1 if out of memory.
+static int
+bgrow(struct buf *g)
+{
+	struct buf *b;
+	char *mem;
+
+	if((mem = kalloc()) == 0)
+		return -1;
+	acquire(&bcache.freelock);
+	for(b = g; b < g+BPP; b++){
+		b->data = (uchar*)mem + (b-g)*BSIZE;
+		b->dev = 0;
+		b->flags = 0;
+		b->refcnt = 0;
+		freepush(b, 0);
+	}
+	release(&bcache.freelock);
+	bcache.nbuf += BPP;
+	return 0;
+}
+
 void
 binit(void)
 {
 	struct buf *b;
+	struct bucket *bk;
 
 	initlock(&bcache.lock, "bcache");
-
-	// Create linked list of buffers
-	bcache.head.prev = &bcache.head;
-	bcache.head.next = &bcache.head;
-	for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-		b->next = bcache.head.next;
-		b->prev = &bcache.head;
+	initlock(&bcache.freelock, "bcache.free");
+	for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+		initlock(&bk->lock, "bcache.bucket");
+	for(b = bcache.buf; b < bcache.buf+NBUFMAX; b++)
 		initsleeplock(&b->lock, "buffer");
-		bcache.head.next->prev = b;
-		bcache.head.next = b;
-	}
+
+	bcache.free.prev = &bcache.free;
+	bcache.free.next = &bcache.free;
+	for(b = bcache.buf; b < bcache.buf+NBUFMIN; b += BPP)
+		if(bgrow(b) < 0)
+			panic("binit");
+	bcache.maxbuf = NBUFMAX;
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
+// Find the block in bucket bk and, if ref is set, take a
+// reference to it.  Caller must hold bk->lock.
 static struct buf*
-bget(uint dev, uint blockno)
+blookup(struct bucket *bk, uint dev, uint blockno, int ref)
 {
 	struct buf *b;
 
-	acquire(&bcache.lock);
-
-	// Is the block already cached?
-	for(b = bcache.head.next; b != &bcache.head; b = b->next){
+	for(b = bk->head; b; b = b->hnext){
 		if(b->dev == dev && b->blockno == blockno){
-			b->refcnt++;
-			release(&bcache.lock);
-			acquiresleep(&b->lock);
+			if(ref && b->refcnt++ == 0){
+				acquire(&bcache.freelock);
+				freeremove(b);
+				release(&bcache.freelock);
+			}
 			return b;
 		}
 	}
+	return 0;
+}
+
+// Take b off the free list and out of its bucket, if it
+// is unused and clean.  A buffer with dev 0 holds no block
+// and is in no bucket.  Caller must hold bcache.lock, so b
+// can't change buckets, but it may be picked up meanwhile.
+// Returns 0, or -1 if b is in use.
+static int
+btake(struct buf *b)
+{
+	struct buf **pp;
+	struct bucket *bk;
 
-	// Not cached; recycle an unused buffer.
+	bk = 0;
+	if(b->dev){
+		bk = bhash(b->dev, b->blockno);
+		acquire(&bk->lock);
+	}
 	// Even if refcnt==0, B_DIRTY indicates a buffer is in use
 	// because log.c has modified it but not yet committed it.
-	for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-		if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-			b->dev = dev;
-			b->blockno = blockno;
-			b->flags = 0;
-			b->refcnt = 1;
-			release(&bcache.lock);
-			acquiresleep(&b->lock);
+	if(b->refcnt != 0 || (b->flags & B_DIRTY)){
+		if(bk)
+			release(&bk->lock);
+		return -1;
+	}
+	if(bk){
+		for(pp = &bk->head; *pp != b; pp = &(*pp)->hnext)
+			;
+		*pp = b->hnext;
+	}
+	acquire(&bcache.freelock);
+	freeremove(b);
+	release(&bcache.freelock);
+	if(bk)
+		release(&bk->lock);
+	return 0;
+}
+
+// Take the least recently used buffer that is unused
+// and clean.  Caller must hold bcache.lock.
+static struct buf*
+brecycle(void)
+{
+	struct buf *b;
+
+	for(;;){
+		acquire(&bcache.freelock);
+		for(b = bcache.free.next; b != &bcache.free; b = b->next)
+			if((b->flags & B_DIRTY) == 0)
+				break;
+		release(&bcache.freelock);
+		if(b == &bcache.free)
+			return 0;
+		if(btake(b) == 0){
+			if(b->dev)
+				bcache.evictions++;
 			return b;
 		}
 	}
-	panic("bget: no buffers");
+}
+
+// Free the data page of a group of buffers above the first
+// NBUFMIN, if none of them is in use.  Caller must hold
+// bcache.lock.  Returns 1 if a page was freed, 0 otherwise.
+static int
+bshrink(void)
+{
+	struct buf *g, *b;
+
+	for(g = bcache.buf+NBUFMAX-BPP; g >= bcache.buf+NBUFMIN; g -= BPP){
+		if(g->data == 0)
+			continue;
+		for(b = g; b < g+BPP; b++)
+			if(btake(b) < 0)
+				break;
+		if(b == g+BPP){
+			kfree((char*)g->data);
+			for(b = g; b < g+BPP; b++)
+				b->data = 0;
+			bcache.nbuf -= BPP;
+			return 1;
+		}
+		// Some buffer is in use; put back the ones taken.
+		acquire(&bcache.freelock);
+		while(--b >= g){
+			b->dev = 0;
+			freepush(b, 0);
+		}
+		release(&bcache.freelock);
+	}
+	return 0;
+}
+
+// Add a page of buffers if the cache may grow.
+// Caller must hold bcache.lock.
+static void
+bexpand(void)
+{
+	struct buf *g;
+
+	if(bcache.nbuf + BPP > bcache.maxbuf || kfreepages() <= BMINFREE)
+		return;
+	for(g = bcache.buf+NBUFMIN; g < bcache.buf+NBUFMAX; g += BPP)
+		if(g->data == 0){
+			bgrow(g);
+			return;
+		}
+}
+
+// Give a page of buffers back to kalloc(), which calls
+// this when it runs out of memory.  Returns 1 if a page
+// was freed, 0 otherwise.
+int
+breclaim(void)
+{
+	int r;
+
+	// kalloc() from bgrow() must not wait for ourselves.
+	if(holding(&bcache.lock))
+		return 0;
+	acquire(&bcache.lock);
+	r = bshrink();
+	release(&bcache.lock);
+	return r;
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return locked buffer.
+// For read-ahead, return 0 instead if the block is
+// cached already or there is no buffer to spare.
+static struct buf*
+bget(uint dev, uint blockno, int ahead)
+{
+	struct buf *b;
+	struct bucket *bk;
+
+	bk = bhash(dev, blockno);
+	acquire(&bk->lock);
+	if((b = blookup(bk, dev, blockno, !ahead)) != 0){
+		release(&bk->lock);
+		if(ahead)
+			return 0;
+		__sync_fetch_and_add(&bcache.hits, 1);
+		acquiresleep(&b->lock);
+		return b;
+	}
+	release(&bk->lock);
+
+	// Not cached; recycle an unused buffer.  Look again
+	// once recycling is ours, in case another process has
+	// brought the block in meanwhile.
+	acquire(&bcache.lock);
+	acquire(&bk->lock);
+	if((b = blookup(bk, dev, blockno, !ahead)) != 0){
+		release(&bk->lock);
+		release(&bcache.lock);
+		if(ahead)
+			return 0;
+		__sync_fetch_and_add(&bcache.hits, 1);
+		acquiresleep(&b->lock);
+		return b;
+	}
+	release(&bk->lock);
+	bcache.misses++;
+
+	if(kfreepages() < BMINFREE)
+		bshrink();
+	else
+		bexpand();
+	if((b = brecycle()) == 0){
+		release(&bcache.lock);
+		if(ahead)
+			return 0;
+		panic("bget: no buffers");
+	}
+	b->dev = dev;
+	b->blockno = blockno;
+	b->flags = 0;
+	b->refcnt = 1;
+	acquire(&bk->lock);
+	b->hnext = bk->head;
+	bk->head = b;
+	release(&bk->lock);
+	release(&bcache.lock);
+	acquiresleep(&b->lock);
+	return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -97,13 +365,34 @@ bread(uint dev, uint blockno)
 {
 	struct buf *b;
 
-	b = bget(dev, blockno);
+	b = bget(dev, blockno, 0);
 	if((b->flags & B_VALID) == 0) {
 		iderw(b);
 	}
 	return b;
 }
 
+// Return a locked buf for the indicated block without reading
+// it, for a caller that is about to overwrite all of it.
+struct buf*
+bgetnew(uint dev, uint blockno)
+{
+	return bget(dev, blockno, 0);
+}
+
+// Start reading the indicated block into the cache, unless
+// it is there already, without waiting for the disk.
+void
+breadahead(uint dev, uint blockno)
+{
+	struct buf *b;
+
+	if((b = bget(dev, blockno, 1)) == 0)
+		return;
+	b->done = bdone;
+	idesubmit(b);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -114,8 +403,49 @@ bwrite(struct buf *b)
 	iderw(b);
 }
 
+// Start writing b's contents to disk and release b when
+// the write is done.  Must be locked; the caller gives
+// up b.  To wait for the write, bread() the block again.
+void
+bawrite(struct buf *b)
+{
+	if(!holdingsleep(&b->lock))
+		panic("bawrite");
+	b->flags |= B_DIRTY;
+	b->done = bdone;
+	idesubmit(b);
+}
+
+// Drop a reference to b.
+// Move to the tail of the free list if no one else uses it.
+static void
+bunref(struct buf *b)
+{
+	struct bucket *bk;
+
+	bk = bhash(b->dev, b->blockno);
+	acquire(&bk->lock);
+	b->refcnt--;
+	if (b->refcnt == 0) {
+		// no one is waiting for it.
+		acquire(&bcache.freelock);
+		freepush(b, 1);
+		release(&bcache.freelock);
+	}
+	release(&bk->lock);
+}
+
+// Release a buffer whose read-ahead or write-behind has
+// completed, on behalf of the process that started it.
+// Called by the disk driver, possibly from an interrupt.
+static void
+bdone(struct buf *b)
+{
+	releasesleep(&b->lock);
+	bunref(b);
+}
+
 // Release a locked buffer.
-// Move to the head of the MRU list.
 void
 brelse(struct buf *b)
 {
@@ -123,19 +453,30 @@ brelse(struct buf *b)
 		panic("brelse");
 
 	releasesleep(&b->lock);
+	bunref(b);
+}
 
+// Fill in *st.  If max is positive, first make it the limit
+// on the size of the cache, shrinking the cache as far as
+// possible if it is over the new limit.  Returns 0.
+int
+bcachestat(struct bcstat *st, int max)
+{
 	acquire(&bcache.lock);
-	b->refcnt--;
-	if (b->refcnt == 0) {
-		// no one is waiting for it.
-		b->next->prev = b->prev;
-		b->prev->next = b->next;
-		b->next = bcache.head.next;
-		b->prev = &bcache.head;
-		bcache.head.next->prev = b;
-		bcache.head.next = b;
+	if(max > 0){
+		if(max < NBUFMIN)
+			max = NBUFMIN;
+		if(max > NBUFMAX)
+			max = NBUFMAX;
+		bcache.maxbuf = max;
+		while(bcache.nbuf > bcache.maxbuf && bshrink())
+			;
 	}
-
+	st->nbuf = bcache.nbuf;
+	st->maxbuf = bcache.maxbuf;
+	st->hits = bcache.hits;
+	st->misses = bcache.misses;
+	st->evictions = bcache.evictions;
 	release(&bcache.lock);
+	return 0;
 }
-
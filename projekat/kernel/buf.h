@@ -4,10 +4,13 @@ struct buf {
 	uint blockno;
 	struct sleeplock lock;
 	uint refcnt;
-	struct buf *prev; // LRU cache list
+	struct buf *prev; // LRU free list
 	struct buf *next;
+	struct buf *hnext; // hash bucket chain
 	struct buf *qnext; // disk queue
-	uchar data[BSIZE];
+	void (*done)(struct buf*); // called by the driver when the request completes
+	uint deadline;     // ticks by which the disk queue should serve it
+	uchar *data;       // BSIZE bytes in a page shared with neighbours
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
@@ -10,6 +10,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "file.h"
+#include "fcntl.h"
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
@@ -29,6 +30,7 @@ static char footers[6][7] = {"[tty 1]", "[tty 2]", "[tty 3]", "[tty 4]", "[tty 5
 static char terminals[6][2000];
 static int currentTerminal = 0;
 static int currentPos[6] = {0,0,0,0,0,0};
+static struct pollent *ttypoll[6];  // poll() waiting for input
 
 struct {
 	char buf[6][INPUT_BUF];
@@ -359,6 +361,7 @@ consoleintr(int (*getc)(void))
 					
 					input.w[currentTerminal] = input.e[currentTerminal];
 					wakeup(&input.r[currentTerminal]);
+					pollwakeup(&ttypoll[currentTerminal]);
 				}
 			}
 			break;
@@ -375,26 +378,30 @@ int
 consoleread(struct inode *ip, char *dst, int n)
 {
 	uint target;
-	int c;
+	int c, t;
 
+	// Read the tty ip names, whichever one is on the screen.
+	t = ip->minor-1;
+	if(t < 0 || t >= 6)
+		return -1;
 	iunlock(ip);
 	target = n;
 	acquire(&cons.lock);
 	while(n > 0){
-		while(input.r[currentTerminal] == input.w[currentTerminal]){
+		while(input.r[t] == input.w[t]){
 			if(myproc()->killed){
 				release(&cons.lock);
 				ilock(ip);
 				return -1;
 			}
-			sleep(&input.r[ip->minor-1], &cons.lock);
+			sleep(&input.r[t], &cons.lock);
 		}
-		c = input.buf[currentTerminal][input.r[currentTerminal]++ % INPUT_BUF];
+		c = input.buf[t][input.r[t]++ % INPUT_BUF];
 		if(c == C('D')){  // EOF
 			if(n < target){
 				// Save ^D for next time, to make sure
 				// caller gets a 0-byte result.
-				input.r[currentTerminal]--;
+				input.r[t]--;
 			}
 			break;
 		}
@@ -449,6 +456,26 @@ consolewrite(struct inode *ip, char *buf, int n)
 	return n;
 }
 
+// A tty is readable once a line has been typed on it, and
+// always writable.
+int
+consolepoll(struct inode *ip, struct pollent *e)
+{
+	int r, t;
+
+	t = ip->minor-1;
+	if(t < 0 || t >= 6)
+		return POLLERR;
+	r = POLLOUT;
+	acquire(&cons.lock);
+	if(e)
+		pollqueue(&ttypoll[t], e);
+	if(input.r[t] != input.w[t])
+		r |= POLLIN;
+	release(&cons.lock);
+	return r;
+}
+
 void
 consoleinit(void)
 {
@@ -456,6 +483,7 @@ consoleinit(void)
 
 	devsw[CONSOLE].write = consolewrite;
 	devsw[CONSOLE].read = consoleread;
+	devsw[CONSOLE].poll = consolepoll;
 	cons.locking = 1;
 
 	initColors();
@@ -1,8 +1,15 @@
+struct bcstat;
 struct buf;
+struct diskstat;
 struct context;
 struct file;
+struct files;
 struct inode;
+struct pcidev;
+struct icstat;
 struct pipe;
+struct pollent;
+struct pollwait;
 struct proc;
 struct rtcdate;
 struct spinlock;
@@ -13,8 +20,13 @@ struct superblock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+void            breadahead(uint, uint);
+struct buf*     bgetnew(uint, uint);
+void            bawrite(struct buf*);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+int             breclaim(void);
+int             bcachestat(struct bcstat*, int);
 
 // console.c
 void            consoleinit(void);
@@ -26,20 +38,33 @@ void            panic(char*) __attribute__((noreturn));
 int             exec(char*, char**);
 
 // file.c
+struct inode*   cwdget(void);
+struct inode*   cwdset(struct inode*);
+int             fdalloc(struct file*);
+struct file*    fdget(int);
+struct file*    fdremove(int);
 struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
+struct files*   filesalloc(void);
+struct files*   filescopy(struct files*);
+struct files*   filesdup(struct files*);
+void            filesput(struct files*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
+int             filepoll(struct file*, struct pollent*);
+int             filesplice(struct file*, uint*, struct file*, int);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
+void            dirunlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+void            icachestat(struct icstat*);
 void            iinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -50,13 +75,23 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+void            readahead(struct inode*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint, int);
+int             futexwake(uint, int);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            idesubmit(struct buf*);
+void            ideawait(struct buf*);
+void            idestat(struct diskstat*, int);
+extern int      ideirq;
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -68,6 +103,7 @@ char*           kalloc(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+int             kfreepages(void);
 
 // kbd.c
 void            kbdintr(void);
@@ -77,6 +113,7 @@ void            cmostime(struct rtcdate *r);
 int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
+void            lapicipi(uchar, int);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
@@ -86,11 +123,28 @@ void            initlog(int dev);
 void            log_write(struct buf*);
 void            begin_op();
 void            end_op();
+void            begin_opn(int);
+void            end_opn(int);
+int             log_maxop(void);
+void            log_sync(void);
+
+// mmap.c
+void            mmapinit(void);
+int             mmap(struct file*, uint, int, int, int);
+int             munmap(uint, int);
+int             mmapfault(uint, uint);
+int             mmapfork(struct proc*, struct proc*);
+void            mmapcloseall(struct proc*);
 
 // mp.c
 extern int      ismp;
 void            mpinit(void);
 
+// pci.c
+int             pcifind(int, int, int, int, struct pcidev*);
+uint            pciread(struct pcidev*, int);
+void            pciwrite(struct pcidev*, int, uint);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
@@ -98,15 +152,29 @@ void            picinit(void);
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
+int             pipepoll(struct pipe*, int, struct pollent*);
 int             piperead(struct pipe*, char*, int);
+int             piperesize(struct pipe*, int);
 int             pipewrite(struct pipe*, char*, int);
 
+// poll.c
+void            pollclock(struct pollent*);
+void            polldequeue(struct pollent*);
+void            pollinit(void);
+void            pollqueue(struct pollent**, struct pollent*);
+void            pollsleep(struct pollwait*);
+void            polltick(void);
+void            pollwakeup(struct pollent**);
+
 // proc.c
+int             clone(uint, uint, uint);
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
 int             growproc(int);
+int             join(uint*);
 int             kill(int);
+void            killthreads(void);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
@@ -115,9 +183,15 @@ void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
+void            tlbintr(void);
+void            tlbshootdown(pde_t*);
 void            userinit(void);
+void            vmlock(void);
+int             vmshared(struct proc*);
+void            vmunlock(void);
 int             wait(void);
 void            wakeup(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 
 // swtch.S
@@ -132,6 +206,15 @@ void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// shm.c
+void            shminit(void);
+int             shmopen(char*);
+int             shmtrunc(int, int);
+int             shmmap(int, int);
+int             shmclose(int);
+int             shmfork(struct proc*, struct proc*);
+void            shmcloseall(struct proc*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -150,6 +233,7 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argrdptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
@@ -176,6 +260,7 @@ pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
+void            unmapuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
@@ -184,6 +269,9 @@ void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+pte_t*          walkpgdir(pde_t*, const void*, int);
+int             mapshared(pde_t*, uint, char**, int, int);
+void            unmapshared(pde_t*, uint, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
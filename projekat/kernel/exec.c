@@ -19,6 +19,10 @@ exec(char *path, char **argv)
 	pde_t *pgdir, *oldpgdir;
 	struct proc *curproc = myproc();
 
+	// Only the thread group leader may replace the address space.
+	if(curproc->leader != curproc)
+		return -1;
+
 	begin_op();
 
 	if((ip = namei(path)) == 0){
@@ -93,6 +97,11 @@ exec(char *path, char **argv)
 			last = s+1;
 	safestrcpy(curproc->name, last, sizeof(curproc->name));
 
+	// Threads, mappings and shared memory are not inherited across exec.
+	killthreads();
+	mmapcloseall(curproc);
+	shmcloseall(curproc);
+
 	// Commit to the user image.
 	oldpgdir = curproc->pgdir;
 	curproc->pgdir = pgdir;
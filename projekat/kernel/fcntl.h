@@ -2,3 +2,21 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+
+#define PROT_READ   0x1
+#define PROT_WRITE  0x2
+
+#define MAP_SHARED  0x1
+#define MAP_PRIVATE 0x2
+
+#define POLLIN   0x01  // can read without blocking
+#define POLLOUT  0x04  // can write without blocking
+#define POLLERR  0x08  // pipe has no readers left
+#define POLLHUP  0x10  // pipe has no writers left
+#define POLLNVAL 0x20  // fd is not open
+
+struct pollfd {
+	int fd;          // ignored if negative
+	short events;    // POLLIN, POLLOUT
+	short revents;   // set by poll()
+};
@@ -5,15 +5,22 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
+#include "proc.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "stat.h"
+#include "fcntl.h"
 
 struct devsw devsw[NDEV];
+// ftable.lock protects the refs of files and tables, and
+// the contents of the tables.
 struct {
 	struct spinlock lock;
 	struct file file[NFILE];
+	struct files files[NPROC];
 } ftable;
 
 void
@@ -79,6 +86,172 @@ fileclose(struct file *f)
 	}
 }
 
+// Allocate an empty table of open files.
+struct files*
+filesalloc(void)
+{
+	struct files *fs;
+
+	acquire(&ftable.lock);
+	for(fs = ftable.files; fs < ftable.files + NPROC; fs++){
+		if(fs->ref == 0){
+			memset(fs, 0, sizeof(*fs));
+			fs->ref = 1;
+			release(&ftable.lock);
+			return fs;
+		}
+	}
+	release(&ftable.lock);
+	return 0;
+}
+
+// Return a new table holding the open files and current
+// directory of fs, for fork().
+struct files*
+filescopy(struct files *fs)
+{
+	struct files *nfs;
+	int fd;
+
+	if((nfs = filesalloc()) == 0)
+		return 0;
+	acquire(&ftable.lock);
+	for(fd = 0; fd < NOFILE; fd++)
+		if((nfs->ofile[fd] = fs->ofile[fd]) != 0)
+			nfs->ofile[fd]->ref++;
+	nfs->cwd = idup(fs->cwd);
+	release(&ftable.lock);
+	return nfs;
+}
+
+// Increment ref count for table fs, for clone().
+struct files*
+filesdup(struct files *fs)
+{
+	acquire(&ftable.lock);
+	if(fs->ref < 1)
+		panic("filesdup");
+	fs->ref++;
+	release(&ftable.lock);
+	return fs;
+}
+
+// Drop a reference to table fs.  The last one closes
+// the files and releases the current directory.
+void
+filesput(struct files *fs)
+{
+	int fd;
+
+	acquire(&ftable.lock);
+	if(fs->ref < 1)
+		panic("filesput");
+	if(fs->ref > 1){
+		fs->ref--;
+		release(&ftable.lock);
+		return;
+	}
+	release(&ftable.lock);
+
+	// No one else can see fs now.
+	for(fd = 0; fd < NOFILE; fd++){
+		if(fs->ofile[fd]){
+			fileclose(fs->ofile[fd]);
+			fs->ofile[fd] = 0;
+		}
+	}
+	begin_op();
+	iput(fs->cwd);
+	end_op();
+	fs->cwd = 0;
+
+	acquire(&ftable.lock);
+	fs->ref = 0;
+	release(&ftable.lock);
+}
+
+// Allocate a file descriptor for f in the current process.
+// Takes over the caller's reference to f on success.
+int
+fdalloc(struct file *f)
+{
+	struct files *fs = myproc()->files;
+	int fd;
+
+	acquire(&ftable.lock);
+	for(fd = 0; fd < NOFILE; fd++){
+		if(fs->ofile[fd] == 0){
+			fs->ofile[fd] = f;
+			release(&ftable.lock);
+			return fd;
+		}
+	}
+	release(&ftable.lock);
+	return -1;
+}
+
+// Return the file open as fd in the current process, with a
+// reference of its own, since another thread may close fd
+// while the caller uses the file.  Returns 0 if fd isn't open.
+struct file*
+fdget(int fd)
+{
+	struct files *fs = myproc()->files;
+	struct file *f;
+
+	if(fd < 0 || fd >= NOFILE)
+		return 0;
+	acquire(&ftable.lock);
+	if((f = fs->ofile[fd]) != 0)
+		f->ref++;
+	release(&ftable.lock);
+	return f;
+}
+
+// Remove fd from the current process's table and return its
+// file; the table's reference passes to the caller.
+struct file*
+fdremove(int fd)
+{
+	struct files *fs = myproc()->files;
+	struct file *f;
+
+	if(fd < 0 || fd >= NOFILE)
+		return 0;
+	acquire(&ftable.lock);
+	f = fs->ofile[fd];
+	fs->ofile[fd] = 0;
+	release(&ftable.lock);
+	return f;
+}
+
+// Return a new reference to the current directory.
+struct inode*
+cwdget(void)
+{
+	struct inode *ip;
+
+	acquire(&ftable.lock);
+	ip = idup(myproc()->files->cwd);
+	release(&ftable.lock);
+	return ip;
+}
+
+// Make ip the current directory, taking over the caller's
+// reference, and return the old one for the caller to iput().
+struct inode*
+cwdset(struct inode *ip)
+{
+	struct files *fs = myproc()->files;
+	struct inode *old;
+
+	acquire(&ftable.lock);
+	old = fs->cwd;
+	fs->cwd = ip;
+	release(&ftable.lock);
+	return old;
+}
+
 // Get metadata about file f.
 int
 filestat(struct file *f, struct stat *st)
@@ -97,6 +270,7 @@ int
 fileread(struct file *f, char *addr, int n)
 {
 	int r;
+	uint end;
 
 	if(f->readable == 0)
 		return -1;
@@ -104,8 +278,17 @@ fileread(struct file *f, char *addr, int n)
 		return piperead(f->pipe, addr, n);
 	if(f->type == FD_INODE){
 		ilock(f->ip);
-		if((r = readi(f->ip, addr, f->off, n)) > 0)
+		if((r = readi(f->ip, addr, f->off, n)) > 0){
+			// Sequential reads are likely to go on:
+			// have the next NRAHEAD blocks read in.
+			if(f->off == f->ranext){
+				end = f->off + r + NRAHEAD*BSIZE;
+				readahead(f->ip, f->raend > f->off + r ? f->raend : f->off + r, end);
+				f->raend = end;
+			}
 			f->off += r;
+			f->ranext = f->off;
+		}
 		iunlock(f->ip);
 		return r;
 	}
@@ -125,23 +308,29 @@ filewrite(struct file *f, char *addr, int n)
 	if(f->type == FD_INODE){
 		// write a few blocks at a time to avoid exceeding
 		// the maximum log transaction size, including
-		// i-node, indirect block, allocation blocks,
+		// i-node, up to 3 indirect blocks, allocation blocks,
 		// and 2 blocks of slop for non-aligned writes.
 		// this really belongs lower down, since writei()
 		// might be writing a device like the console.
-		int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+		// big writes reserve more of the log per transaction.
+		int nop = MAXOPBLOCKS;
+		int max = ((nop-1-3-2) / 2) * BSIZE;
+		if(n > max){
+			nop = log_maxop();
+			max = ((nop-1-3-2) / 2) * BSIZE;
+		}
 		int i = 0;
 		while(i < n){
 			int n1 = n - i;
 			if(n1 > max)
 				n1 = max;
 
-			begin_op();
+			begin_opn(nop);
 			ilock(f->ip);
 			if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
 				f->off += r;
 			iunlock(f->ip);
-			end_op();
+			end_opn(nop);
 
 			if(r < 0)
 				break;
@@ -154,3 +343,69 @@ filewrite(struct file *f, char *addr, int n)
 	panic("filewrite");
 }
 
+// Return the POLL* flags that hold for f, and queue e to be
+// woken when they change.  Files and devices without a poll
+// function never block, so they are always ready.
+int
+filepoll(struct file *f, struct pollent *e)
+{
+	struct inode *ip;
+	int r;
+
+	if(f->type == FD_PIPE)
+		return pipepoll(f->pipe, f->writable, e);
+	if(f->type == FD_INODE){
+		ip = f->ip;
+		if(ip->type == T_DEV && ip->major >= 0 && ip->major < NDEV &&
+		   devsw[ip->major].poll)
+			return devsw[ip->major].poll(ip, e);
+		r = 0;
+		if(f->readable)
+			r |= POLLIN;
+		if(f->writable)
+			r |= POLLOUT;
+		return r;
+	}
+	panic("filepoll");
+}
+
+// Move up to n bytes from fin to fout inside the kernel, through
+// a page of kernel memory rather than the caller's.  If off is
+// not 0, fin must be an inode, and it is read at *off, which is
+// advanced, instead of at its file offset.  Like read(), stops
+// after a short read, so a pipe or the console gives what it has.
+// Returns the number of bytes moved.
+int
+filesplice(struct file *fin, uint *off, struct file *fout, int n)
+{
+	char *buf;
+	int m, r, tot;
+
+	if(fin->readable == 0 || fout->writable == 0 || n < 0)
+		return -1;
+	if(off && fin->type != FD_INODE)
+		return -1;
+	if((buf = kalloc()) == 0)
+		return -1;
+	for(tot = 0; tot < n; tot += r){
+		m = n - tot < PGSIZE ? n - tot : PGSIZE;
+		if(off){
+			ilock(fin->ip);
+			if((r = readi(fin->ip, buf, *off, m)) > 0)
+				*off += r;
+			iunlock(fin->ip);
+		} else
+			r = fileread(fin, buf, m);
+		if(r <= 0 || filewrite(fout, buf, r) != r){
+			if(r != 0 && tot == 0)
+				tot = -1;
+			break;
+		}
+		if(r < m){
+			tot += r;
+			break;
+		}
+	}
+	kfree(buf);
+	return tot;
+}
@@ -6,6 +6,17 @@ struct file {
 	struct pipe *pipe;
 	struct inode *ip;
 	uint off;
+	uint ranext;  // offset at which a sequential read would go on
+	uint raend;   // end of the range read ahead so far
+};
+
+// Open files and current directory of a process.  The threads
+// clone() makes share their process's table; fork() gives the
+// child a copy.
+struct files {
+	int ref;                     // processes and threads using it
+	struct file *ofile[NOFILE];  // Open files
+	struct inode *cwd;           // Current directory
 };
 
 
@@ -22,14 +33,37 @@ struct inode {
 	short minor;
 	short nlink;
 	uint size;
-	uint addrs[NDIRECT+1];
+	uint addrs[NDIRECT+2];
+
+	uint runbn;         // bmap: file blocks runbn .. runbn+runlen-1
+	uint runlen;        // are in disk blocks runaddr ..
+	uint runaddr;
+	uint goal;          // balloc: next block to try, 0 if none
+
+	struct inode *hnext;  // icache hash chain
+	struct inode *prev;   // icache LRU list of unreferenced inodes
+	struct inode *next;
+};
+
+// A poll() call, and its entry on the queue of one of the
+// files it waits for; see poll.c.
+struct pollwait {
+	int woken;
+};
+
+struct pollent {
+	struct pollent *next;
+	struct pollent **q;     // queue it is on, or 0
+	struct pollwait *w;
 };
 
 // table mapping major device number to
-// device functions
+// device functions.  poll returns the POLL* flags that hold
+// and, if e is not 0, queues e to be woken when that changes.
 struct devsw {
 	int (*read)(struct inode*, char*, int);
 	int (*write)(struct inode*, char*, int);
+	int (*poll)(struct inode*, struct pollent *e);
 };
 
 extern struct devsw devsw[];
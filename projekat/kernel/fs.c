@@ -23,11 +23,14 @@
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
+static void dcacheinit(void);
+static void dcachepurge(uint, uint);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb;
 
-// Read the super block.
+// Read the super block.  The file system must have been
+// made for the block size the kernel was built with.
 void
 readsb(int dev, struct superblock *sb)
 {
@@ -36,41 +39,127 @@ readsb(int dev, struct superblock *sb)
 	bp = bread(dev, 1);
 	memmove(sb, bp->data, sizeof(*sb));
 	brelse(bp);
+	if(sb->magic != FSMAGIC)
+		panic("readsb: not a file system");
+	if(sb->bsize != BSIZE)
+		panic("readsb: wrong block size");
 }
 
-// Zero a block.
+// Zero a block.  The old contents don't matter,
+// so the block is not read from disk first.
 static void
 bzero(int dev, int bno)
 {
 	struct buf *bp;
 
-	bp = bread(dev, bno);
+	bp = bgetnew(dev, bno);
 	memset(bp->data, 0, BSIZE);
+	bp->flags |= B_VALID;
 	log_write(bp);
 	brelse(bp);
 }
 
 // Blocks.
+//
+// bsum keeps the number of free blocks under each bitmap
+// block, so balloc() skips full bitmap blocks without
+// reading them.  The bitmap itself stays the authority:
+// a count is only a hint until the bitmap block is locked.
+//
+// balloc() takes a goal and returns the first free block at
+// or after it, scanning a byte of the bitmap at a time.  Files
+// ask for the block after the one they got last (ip->goal), so
+// a growing file stays contiguous.  ip->goal is not on disk:
+// writei() sets it again from the file's last block when it
+// appends to an inode that was read back in.  A new file starts
+// at bsum.next, which then moves on by NPREALLOC blocks.  That
+// is only a soft reservation: nothing stops other files from
+// allocating in the run, so files growing at the same time stay
+// apart only until one of them outgrows NPREALLOC blocks.
+
+static struct {
+	struct spinlock lock;
+	ushort *nfree;  // free blocks per bitmap block
+	int nbmap;      // number of bitmap blocks
+	uint next;      // where a file without a goal starts
+} bsum;
+
+// Return the first clear bit of map in from .. to-1, or -1.
+static int
+bitfind(uchar *map, int from, int to)
+{
+	int bi;
+
+	for(bi = from; bi < to; bi++){
+		if(bi % 8 == 0){
+			// Skip whole bytes of blocks in use.
+			while(bi + 8 <= to && map[bi/8] == 0xff)
+				bi += 8;
+			if(bi >= to)
+				break;
+		}
+		if((map[bi/8] & (1 << (bi % 8))) == 0)
+			return bi;
+	}
+	return -1;
+}
 
-// Allocate a zeroed disk block.
+// Count the free blocks under each bitmap block.
+static void
+bsuminit(int dev)
+{
+	struct buf *bp;
+	int i, bi, n;
+	uint first;
+
+	initlock(&bsum.lock, "bsum");
+	bsum.nbmap = (sb.size + BPB - 1) / BPB;
+	if(bsum.nbmap*sizeof(ushort) > PGSIZE || (bsum.nfree = (ushort*)kalloc()) == 0)
+		panic("bsuminit");
+	first = 0;
+	for(i = 0; i < bsum.nbmap; i++){
+		bp = bread(dev, sb.bmapstart + i);
+		n = 0;
+		for(bi = 0; bi < BPB && i*BPB + bi < sb.size; bi++){
+			if((bp->data[bi/8] & (1 << (bi % 8))) == 0){
+				if(n++ == 0 && first == 0)
+					first = i*BPB + bi;
+			}
+		}
+		brelse(bp);
+		bsum.nfree[i] = n;
+	}
+	bsum.next = first;
+}
+
+// Allocate a zeroed disk block, the first free one
+// at or after goal.
 static uint
-balloc(uint dev)
+balloc(uint dev, uint goal)
 {
-	int b, bi, m;
+	int i, bn, bi, from;
 	struct buf *bp;
 
-	bp = 0;
-	for(b = 0; b < sb.size; b += BPB){
-		bp = bread(dev, BBLOCK(b, sb));
-		for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-			m = 1 << (bi % 8);
-			if((bp->data[bi/8] & m) == 0){  // Is block free?
-				bp->data[bi/8] |= m;  // Mark block in use.
-				log_write(bp);
-				brelse(bp);
-				bzero(dev, b + bi);
-				return b + bi;
-			}
+	if(goal >= sb.size)
+		goal = 0;
+	for(i = 0; i <= bsum.nbmap; i++){
+		bn = (goal/BPB + i) % bsum.nbmap;
+		if(bsum.nfree[bn] == 0)
+			continue;
+		// Past the goal in its own bitmap block; from the
+		// start of that block again after wrapping around.
+		from = i == 0 ? goal % BPB : 0;
+		bp = bread(dev, sb.bmapstart + bn);
+		bi = bitfind(bp->data, from, min(BPB, sb.size - bn*BPB));
+		if(bi >= 0){
+			bp->data[bi/8] |= 1 << (bi % 8);  // Mark block in use.
+			log_write(bp);
+			brelse(bp);
+			acquire(&bsum.lock);
+			bsum.nfree[bn]--;
+			release(&bsum.lock);
+			bzero(dev, bn*BPB + bi);
+			return bn*BPB + bi;
 		}
 		brelse(bp);
 	}
@@ -92,6 +181,28 @@ bfree(int dev, uint b)
 	bp->data[bi/8] &= ~m;
 	log_write(bp);
 	brelse(bp);
+	acquire(&bsum.lock);
+	bsum.nfree[b / BPB]++;
+	release(&bsum.lock);
+}
+
+// Allocate a block for ip, after the one it got last.
+static uint
+iballoc(struct inode *ip)
+{
+	uint addr;
+
+	if(ip->goal == 0){
+		acquire(&bsum.lock);
+		ip->goal = bsum.next;
+		bsum.next += NPREALLOC;
+		if(bsum.next >= sb.size)
+			bsum.next = 0;
+		release(&bsum.lock);
+	}
+	addr = balloc(ip->dev, ip->goal);
+	ip->goal = addr + 1;
+	return addr;
 }
 
 // Inodes.
@@ -120,7 +231,7 @@ bfree(int dev, uint b)
 //   the reference and link counts have fallen to zero.
 //
 // * Referencing in cache: an entry in the inode cache
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
+//   can be recycled if ip->ref is zero. Otherwise ip->ref tracks
 //   the number of in-memory pointers to the entry (open
 //   files and current directories). iget() finds or
 //   creates a cache entry and increments its ref; iput()
@@ -130,7 +241,8 @@ bfree(int dev, uint b)
 //   cache entry is only correct when ip->valid is 1.
 //   ilock() reads the inode from
 //   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ip->valid if it frees the inode, and iget() if it
+//   recycles the entry for another inode.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -155,34 +267,92 @@ bfree(int dev, uint b)
 // multi-step atomic operations.
 //
 // The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
+// entries. Since ip->ref indicates whether an entry is in use,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold icache.lock while using any of those fields.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// dev, inum and the icache links.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
+//
+// Entries are found through a hash table on (dev, inum).  An
+// entry whose ref drops to 0 keeps its inode, still valid, on
+// an LRU list; iget() of that inode takes it back without
+// reading the disk, and a miss recycles the least recently
+// used entry.  The number of entries is fixed at boot from
+// the amount of free memory.
 
 struct {
 	struct spinlock lock;
-	struct inode inode[NINODE];
+	struct inode *hash[NIHASH];
+	struct inode lru;  // lru.next is most recently used
+	int ninode;
+	int nref;          // entries with ref > 0
+	uint hits;
+	uint misses;
 } icache;
 
+static struct inode**
+ihash(uint dev, uint inum)
+{
+	return &icache.hash[(dev*31 + inum) % NIHASH];
+}
+
+// Take ip off the LRU list.  Caller must hold icache.lock.
+static void
+lruremove(struct inode *ip)
+{
+	ip->next->prev = ip->prev;
+	ip->prev->next = ip->next;
+}
+
+// Put ip at the most recently used end of the LRU list.
+// Caller must hold icache.lock.
+static void
+lrupush(struct inode *ip)
+{
+	ip->next = icache.lru.next;
+	ip->prev = &icache.lru;
+	icache.lru.next->prev = ip;
+	icache.lru.next = ip;
+}
+
 void
 iinit(int dev)
 {
-	int i = 0;
+	struct inode *ip;
+	char *page;
+	int n;
 
 	initlock(&icache.lock, "icache");
-	for(i = 0; i < NINODE; i++) {
-		initsleeplock(&icache.inode[i].lock, "inode");
+	dcacheinit();
+
+	// One inode per 16 free pages, within NINODE .. NINODEMAX.
+	n = kfreepages() / 16;
+	if(n < NINODE)
+		n = NINODE;
+	if(n > NINODEMAX)
+		n = NINODEMAX;
+	icache.lru.next = icache.lru.prev = &icache.lru;
+	while(icache.ninode < n){
+		if((page = kalloc()) == 0)
+			break;
+		memset(page, 0, PGSIZE);
+		for(ip = (struct inode*)page; (char*)(ip+1) <= page + PGSIZE; ip++){
+			initsleeplock(&ip->lock, "inode");
+			lrupush(ip);
+			icache.ninode++;
+		}
 	}
+	if(icache.ninode < NINODE)
+		panic("iinit: no memory");
 
 	readsb(dev, &sb);
 	cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
  inodestart %d bmap start %d\n", sb.size, sb.nblocks,
 		sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
 		sb.bmapstart);
+	bsuminit(dev);
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -240,36 +410,60 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-	struct inode *ip, *empty;
+	struct inode *ip, *empty, **pp;
 
 	acquire(&icache.lock);
 
 	// Is the inode already cached?
-	empty = 0;
-	for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-		if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-			ip->ref++;
+	for(ip = *ihash(dev, inum); ip; ip = ip->hnext){
+		if(ip->dev == dev && ip->inum == inum){
+			if(ip->ref++ == 0){
+				lruremove(ip);
+				icache.nref++;
+			}
+			icache.hits++;
 			release(&icache.lock);
 			return ip;
 		}
-		if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-			empty = ip;
 	}
 
-	// Recycle an inode cache entry.
-	if(empty == 0)
+	// Recycle the least recently used inode cache entry.
+	if((empty = icache.lru.prev) == &icache.lru)
 		panic("iget: no inodes");
+	icache.misses++;
 
 	ip = empty;
+	lruremove(ip);
+	if(ip->inum != 0){
+		for(pp = ihash(ip->dev, ip->inum); *pp != ip; pp = &(*pp)->hnext)
+			;
+		*pp = ip->hnext;
+	}
 	ip->dev = dev;
 	ip->inum = inum;
 	ip->ref = 1;
 	ip->valid = 0;
+	pp = ihash(dev, inum);
+	ip->hnext = *pp;
+	*pp = ip;
+	icache.nref++;
 	release(&icache.lock);
 
 	return ip;
 }
 
+// Fill in *st with the inode cache statistics.
+void
+icachestat(struct icstat *st)
+{
+	acquire(&icache.lock);
+	st->ninode = icache.ninode;
+	st->nref = icache.nref;
+	st->hits = icache.hits;
+	st->misses = icache.misses;
+	release(&icache.lock);
+}
+
 // Increment reference count for ip.
 // Returns ip to enable ip = idup(ip1) idiom.
 struct inode*
@@ -303,6 +497,8 @@ ilock(struct inode *ip)
 		ip->nlink = dip->nlink;
 		ip->size = dip->size;
 		memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+		ip->runlen = 0;
+		ip->goal = 0;
 		brelse(bp);
 		ip->valid = 1;
 		if(ip->type == 0)
@@ -337,6 +533,8 @@ iput(struct inode *ip)
 		release(&icache.lock);
 		if(r == 1){
 			// inode has no links and no other references: truncate and free.
+			if(ip->type == T_DIR)
+				dcachepurge(ip->dev, ip->inum);
 			itrunc(ip);
 			ip->type = 0;
 			iupdate(ip);
@@ -346,7 +544,10 @@ iput(struct inode *ip)
 	releasesleep(&ip->lock);
 
 	acquire(&icache.lock);
-	ip->ref--;
+	if(--ip->ref == 0){
+		lrupush(ip);
+		icache.nref--;
+	}
 	release(&icache.lock);
 }
 
@@ -363,38 +564,100 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT].  The NDINDIRECT after
+// those are listed in the blocks listed in the doubly-indirect
+// block ip->addrs[NDIRECT+1].
+//
+// bmap() remembers in ip->run* the last run it found of file
+// blocks in consecutive disk blocks, so lookups in a file
+// that was written contiguously read an indirect block only
+// once per run.
+
+// Return entry i of the indirect block at addr, allocating
+// a block for it if it is empty.  If run is not 0, set *run
+// to the number of entries from i on that list consecutive
+// disk blocks.
+static uint
+indirect(struct inode *ip, uint addr, uint i, uint *run)
+{
+	uint *a, n;
+	struct buf *bp;
+
+	bp = bread(ip->dev, addr);
+	a = (uint*)bp->data;
+	if((addr = a[i]) == 0){
+		a[i] = addr = iballoc(ip);
+		log_write(bp);
+	}
+	if(run){
+		for(n = 1; i+n < NINDIRECT && a[i+n] == addr+n; n++)
+			;
+		*run = n;
+	}
+	brelse(bp);
+	return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
+// Caller must hold ip->lock.
 static uint
 bmap(struct inode *ip, uint bn)
 {
-	uint addr, *a;
-	struct buf *bp;
+	uint addr, run, fbn;
 
 	if(bn < NDIRECT){
 		if((addr = ip->addrs[bn]) == 0)
-			ip->addrs[bn] = addr = balloc(ip->dev);
+			ip->addrs[bn] = addr = iballoc(ip);
 		return addr;
 	}
+	if(bn - ip->runbn < ip->runlen)
+		return ip->runaddr + (bn - ip->runbn);
+	fbn = bn;
 	bn -= NDIRECT;
 
 	if(bn < NINDIRECT){
 		// Load indirect block, allocating if necessary.
 		if((addr = ip->addrs[NDIRECT]) == 0)
-			ip->addrs[NDIRECT] = addr = balloc(ip->dev);
-		bp = bread(ip->dev, addr);
-		a = (uint*)bp->data;
-		if((addr = a[bn]) == 0){
-			a[bn] = addr = balloc(ip->dev);
-			log_write(bp);
-		}
-		brelse(bp);
-		return addr;
-	}
+			ip->addrs[NDIRECT] = addr = iballoc(ip);
+		addr = indirect(ip, addr, bn, &run);
+	} else if(bn - NINDIRECT < NDINDIRECT){
+		bn -= NINDIRECT;
+		if((addr = ip->addrs[NDIRECT+1]) == 0)
+			ip->addrs[NDIRECT+1] = addr = iballoc(ip);
+		addr = indirect(ip, addr, bn / NINDIRECT, 0);
+		addr = indirect(ip, addr, bn % NINDIRECT, &run);
+	} else
+		panic("bmap: out of range");
+
+	ip->runbn = fbn;
+	ip->runlen = run;
+	ip->runaddr = addr;
+	return addr;
+}
 
-	panic("bmap: out of range");
+// Free the blocks listed in the indirect block at addr,
+// descending depth more levels of indirect blocks, and
+// then the block itself.
+static void
+ifree(struct inode *ip, uint addr, int depth)
+{
+	struct buf *bp;
+	uint *a;
+	int j;
+
+	bp = bread(ip->dev, addr);
+	a = (uint*)bp->data;
+	for(j = 0; j < NINDIRECT; j++){
+		if(a[j] == 0)
+			continue;
+		if(depth > 0)
+			ifree(ip, a[j], depth-1);
+		else
+			bfree(ip->dev, a[j]);
+	}
+	brelse(bp);
+	bfree(ip->dev, addr);
 }
 
 // Truncate inode (discard contents).
@@ -405,9 +668,7 @@ bmap(struct inode *ip, uint bn)
 static void
 itrunc(struct inode *ip)
 {
-	int i, j;
-	struct buf *bp;
-	uint *a;
+	int i;
 
 	for(i = 0; i < NDIRECT; i++){
 		if(ip->addrs[i]){
@@ -416,18 +677,15 @@ itrunc(struct inode *ip)
 		}
 	}
 
-	if(ip->addrs[NDIRECT]){
-		bp = bread(ip->dev, ip->addrs[NDIRECT]);
-		a = (uint*)bp->data;
-		for(j = 0; j < NINDIRECT; j++){
-			if(a[j])
-				bfree(ip->dev, a[j]);
+	for(i = 0; i < 2; i++){
+		if(ip->addrs[NDIRECT+i]){
+			ifree(ip, ip->addrs[NDIRECT+i], i);
+			ip->addrs[NDIRECT+i] = 0;
 		}
-		brelse(bp);
-		bfree(ip->dev, ip->addrs[NDIRECT]);
-		ip->addrs[NDIRECT] = 0;
 	}
 
+	ip->runlen = 0;
+	ip->goal = 0;
 	ip->size = 0;
 	iupdate(ip);
 }
@@ -472,6 +730,22 @@ readi(struct inode *ip, char *dst, uint off, uint n)
 	return n;
 }
 
+// Start reading the blocks of ip that hold bytes [off, end)
+// into the cache, without waiting for them.
+// Caller must hold ip->lock.
+void
+readahead(struct inode *ip, uint off, uint end)
+{
+	uint bn;
+
+	if(ip->type == T_DEV)
+		return;
+	if(end > ip->size)
+		end = ip->size;
+	for(bn = off/BSIZE; bn*BSIZE < end; bn++)
+		breadahead(ip->dev, bmap(ip, bn));
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 int
@@ -488,9 +762,13 @@ writei(struct inode *ip, char *src, uint off, uint n)
 
 	if(off > ip->size || off + n < off)
 		return -1;
-	if(off + n > MAXFILE*BSIZE)
+	if((uint64)off + n > (uint64)MAXFILE*BSIZE)
 		return -1;
 
+	// Continue after the last block of a file read back in.
+	if(ip->goal == 0 && ip->size > 0 && off + n > ip->size)
+		ip->goal = bmap(ip, (ip->size - 1)/BSIZE) + 1;
+
 	for(tot=0; tot<n; tot+=m, off+=m, src+=m){
 		bp = bread(ip->dev, bmap(ip, off/BSIZE));
 		m = min(n - tot, BSIZE - off%BSIZE);
@@ -514,17 +792,349 @@ namecmp(const char *s, const char *t)
 	return strncmp(s, t, DIRSIZ);
 }
 
+// Directory lookup cache.
+//
+// The dcache remembers what dirlookup() found for a name in
+// a directory: the inode number and offset of its entry, or
+// that there is no such entry (inum 0).  Entries are hashed
+// by directory and name, and replaced round-robin.
+//
+// Directories only change with the directory locked, in
+// dirlink() and dirunlink(), which keep the cache up to date;
+// dirlookup() is also called with the directory locked, so
+// it never sees a half-made change.  When an inode is freed,
+// iput() drops the entries for it as a directory, since its
+// inode number may come back as a different directory.
+
+struct dentry {
+	uint dev;
+	uint dinum;            // directory
+	char name[DIRSIZ];
+	uint inum;             // 0 if name is not in the directory
+	uint off;              // offset of the entry if inum != 0
+	struct dentry *hnext;  // hash chain; dinum 0 if unused
+};
+
+struct {
+	struct spinlock lock;
+	struct dentry entry[NDCACHE];
+	struct dentry *hash[NDHASH];
+	int next;              // next entry to replace
+} dcache;
+
+static void
+dcacheinit(void)
+{
+	initlock(&dcache.lock, "dcache");
+}
+
+static struct dentry**
+dhash(uint dev, uint dinum, char *name)
+{
+	uint h;
+	int i;
+
+	h = dev*31 + dinum;
+	for(i = 0; i < DIRSIZ && name[i]; i++)
+		h = h*31 + (uchar)name[i];
+	return &dcache.hash[h % NDHASH];
+}
+
+// Find the entry for name in directory dp.
+// Caller must hold dcache.lock.
+static struct dentry*
+dfind(struct inode *dp, char *name)
+{
+	struct dentry *d;
+
+	for(d = *dhash(dp->dev, dp->inum, name); d; d = d->hnext)
+		if(d->dev == dp->dev && d->dinum == dp->inum && namecmp(d->name, name) == 0)
+			return d;
+	return 0;
+}
+
+// Take d out of its hash chain and mark it unused.
+// Caller must hold dcache.lock.
+static void
+dremove(struct dentry *d)
+{
+	struct dentry **pp;
+
+	for(pp = dhash(d->dev, d->dinum, d->name); *pp; pp = &(*pp)->hnext)
+		if(*pp == d){
+			*pp = d->hnext;
+			break;
+		}
+	d->dinum = 0;
+}
+
+// Record that name in directory dp refers to inum at off
+// (or to nothing, if inum is 0).  Caller must hold dp->lock.
+static void
+dcacheset(struct inode *dp, char *name, uint inum, uint off)
+{
+	struct dentry *d, **pp;
+
+	acquire(&dcache.lock);
+	if((d = dfind(dp, name)) == 0){
+		d = &dcache.entry[dcache.next];
+		dcache.next = (dcache.next + 1) % NDCACHE;
+		if(d->dinum)
+			dremove(d);
+		d->dev = dp->dev;
+		d->dinum = dp->inum;
+		strncpy(d->name, name, DIRSIZ);
+		pp = dhash(d->dev, d->dinum, d->name);
+		d->hnext = *pp;
+		*pp = d;
+	}
+	d->inum = inum;
+	d->off = off;
+	release(&dcache.lock);
+}
+
+// Forget the entries of directory inum, which is being freed.
+static void
+dcachepurge(uint dev, uint inum)
+{
+	struct dentry *d;
+
+	acquire(&dcache.lock);
+	for(d = dcache.entry; d < &dcache.entry[NDCACHE]; d++)
+		if(d->dinum == inum && d->dev == dev)
+			dremove(d);
+	release(&dcache.lock);
+}
+
+// Hashed directories; see fs.h.  Names are looked up and
+// inserted by reading the header and one bucket.  A full
+// bucket is split in two, doubling the table first if needed,
+// so lookups never follow chains.  A plain directory becomes
+// a hashed one when it needs to grow past its first block
+// (and its entries fit in a page to be moved).
+
+static uint
+dirhash(char *name)
+{
+	uint h;
+	int i;
+
+	h = 2166136261;
+	for(i = 0; i < DIRSIZ && name[i]; i++){
+		h ^= (uchar)name[i];
+		h *= 16777619;
+	}
+	return h;
+}
+
+// Depth kept in the first dirent of a header or bucket block.
+static ushort*
+hdepth(uchar *data)
+{
+	return (ushort*)((struct dirent*)data)[0].name;
+}
+
+// Entry i of the table in a header block.
+static ushort*
+htable(uchar *data, int i)
+{
+	return (ushort*)((struct dirent*)data)[1 + i/DIRTABPS].name + i%DIRTABPS;
+}
+
+// Read block bn of directory dp.
+static struct buf*
+dirblock(struct inode *dp, uint bn)
+{
+	return bread(dp->dev, bmap(dp, bn));
+}
+
+// Return the block number of the bucket for hash h.
+static uint
+hdirbucket(struct inode *dp, uint h)
+{
+	struct buf *hp;
+	uint bn;
+
+	hp = dirblock(dp, 0);
+	bn = *htable(hp->data, h & ((1 << *hdepth(hp->data)) - 1));
+	brelse(hp);
+	return bn;
+}
+
+// Split the full bucket at block bn of hashed directory dp,
+// moving the entries whose next hash bit is set to a new
+// bucket at the end of the directory.  Doubles the table
+// first if it has only one entry for the bucket.
+// Returns -1 if the table can't grow.
+static int
+hdirsplit(struct inode *dp, uint bn)
+{
+	struct buf *hp, *bp, *np;
+	struct dirent *ob, *nb;
+	uint g, ld, nbn, i, j, n;
+
+	hp = dirblock(dp, 0);
+	g = *hdepth(hp->data);
+	bp = dirblock(dp, bn);
+	ld = *hdepth(bp->data);
+	if(ld == g){
+		n = 1 << g;
+		if(2*n > DIRTABMAX){
+			brelse(bp);
+			brelse(hp);
+			return -1;
+		}
+		for(i = 0; i < n; i++)
+			*htable(hp->data, n + i) = *htable(hp->data, i);
+		*hdepth(hp->data) = ++g;
+	}
+
+	nbn = dp->size / BSIZE;
+	np = dirblock(dp, nbn);  // allocates a zeroed block
+	dp->size += BSIZE;
+	iupdate(dp);
+
+	*hdepth(bp->data) = *hdepth(np->data) = ld + 1;
+	ob = (struct dirent*)bp->data;
+	nb = (struct dirent*)np->data;
+	for(i = j = 1; i < DPB; i++){
+		if(ob[i].inum == 0 || ((dirhash(ob[i].name) >> ld) & 1) == 0)
+			continue;
+		nb[j] = ob[i];
+		dcacheset(dp, nb[j].name, nb[j].inum, nbn*BSIZE + j*sizeof(*nb));
+		memset(&ob[i], 0, sizeof(ob[i]));
+		j++;
+	}
+	for(i = 0; i < (1 << g); i++)
+		if(*htable(hp->data, i) == bn && ((i >> ld) & 1))
+			*htable(hp->data, i) = nbn;
+
+	log_write(np);
+	log_write(bp);
+	log_write(hp);
+	brelse(np);
+	brelse(bp);
+	brelse(hp);
+	return 0;
+}
+
+// Add (name, inum) to hashed directory dp.
+static int
+hdirlink(struct inode *dp, char *name, uint inum)
+{
+	struct buf *bp;
+	struct dirent *de;
+	uint h, bn, i;
+
+	h = dirhash(name);
+	for(;;){
+		bn = hdirbucket(dp, h);
+		bp = dirblock(dp, bn);
+		de = (struct dirent*)bp->data;
+		for(i = 1; i < DPB; i++){
+			if(de[i].inum == 0){
+				strncpy(de[i].name, name, DIRSIZ);
+				de[i].inum = inum;
+				log_write(bp);
+				brelse(bp);
+				dcacheset(dp, name, inum, bn*BSIZE + i*sizeof(*de));
+				return 0;
+			}
+		}
+		brelse(bp);
+		if(hdirsplit(dp, bn) < 0)
+			return -1;
+	}
+}
+
+// Turn the plain directory dp into a hashed one, with a
+// bucket for each of its blocks.  Returns -1, leaving dp
+// as it was, if its entries don't fit in a page.
+static int
+hdirconvert(struct inode *dp)
+{
+	struct dirent *old;
+	struct buf *bp;
+	uint g, n, bn, i;
+
+	if(dp->size > PGSIZE || (old = (struct dirent*)kalloc()) == 0)
+		return -1;
+	n = dp->size / sizeof(*old);
+	if(readi(dp, (char*)old, 0, dp->size) != dp->size)
+		panic("hdirconvert read");
+
+	for(g = 1; (1 << g) < dp->size/BSIZE; g++)
+		;
+	for(bn = 0; bn <= (1 << g); bn++){
+		bp = dirblock(dp, bn);
+		memset(bp->data, 0, BSIZE);
+		if(bn == 0){
+			*hdepth(bp->data) = g;
+			for(i = 0; i < (1 << g); i++)
+				*htable(bp->data, i) = 1 + i;
+		} else
+			*hdepth(bp->data) = g;
+		log_write(bp);
+		brelse(bp);
+	}
+	dp->size = bn*BSIZE;
+	dp->major = DIRHASHED;
+	iupdate(dp);
+	dcachepurge(dp->dev, dp->inum);
+
+	for(i = 0; i < n; i++)
+		if(old[i].inum != 0 && hdirlink(dp, old[i].name, old[i].inum) < 0)
+			panic("hdirconvert");
+	kfree((char*)old);
+	return 0;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-	uint off, inum;
-	struct dirent de;
+	uint off, inum, bn, i;
+	struct dirent de, *dd;
+	struct dentry *d;
+	struct buf *bp;
 
 	if(dp->type != T_DIR)
 		panic("dirlookup not DIR");
 
+	acquire(&dcache.lock);
+	if((d = dfind(dp, name)) != 0){
+		inum = d->inum;
+		off = d->off;
+		release(&dcache.lock);
+		if(inum == 0)
+			return 0;
+		if(poff)
+			*poff = off;
+		return iget(dp->dev, inum);
+	}
+	release(&dcache.lock);
+
+	if(dp->major == DIRHASHED){
+		bn = hdirbucket(dp, dirhash(name));
+		bp = dirblock(dp, bn);
+		dd = (struct dirent*)bp->data;
+		for(i = 1; i < DPB; i++){
+			if(dd[i].inum != 0 && namecmp(name, dd[i].name) == 0){
+				inum = dd[i].inum;
+				off = bn*BSIZE + i*sizeof(*dd);
+				brelse(bp);
+				if(poff)
+					*poff = off;
+				dcacheset(dp, name, inum, off);
+				return iget(dp->dev, inum);
+			}
+		}
+		brelse(bp);
+		dcacheset(dp, name, 0, 0);
+		return 0;
+	}
+
 	for(off = 0; off < dp->size; off += sizeof(de)){
 		if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
 			panic("dirlookup read");
@@ -535,10 +1145,12 @@ dirlookup(struct inode *dp, char *name, uint *poff)
 			if(poff)
 				*poff = off;
 			inum = de.inum;
+			dcacheset(dp, name, inum, off);
 			return iget(dp->dev, inum);
 		}
 	}
 
+	dcacheset(dp, name, 0, 0);
 	return 0;
 }
 
@@ -556,6 +1168,9 @@ dirlink(struct inode *dp, char *name, uint inum)
 		return -1;
 	}
 
+	if(dp->major == DIRHASHED)
+		return hdirlink(dp, name, inum);
+
 	// Look for an empty dirent.
 	for(off = 0; off < dp->size; off += sizeof(de)){
 		if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
@@ -564,14 +1179,33 @@ dirlink(struct inode *dp, char *name, uint inum)
 			break;
 	}
 
+	// Switch to the hashed format rather than grow
+	// a plain directory past its first block.
+	if(off == dp->size && off >= BSIZE && hdirconvert(dp) == 0)
+		return hdirlink(dp, name, inum);
+
 	strncpy(de.name, name, DIRSIZ);
 	de.inum = inum;
 	if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
 		panic("dirlink");
+	dcacheset(dp, name, inum, off);
 
 	return 0;
 }
 
+// Remove the entry for name, found by dirlookup() at off,
+// from the directory dp.
+void
+dirunlink(struct inode *dp, char *name, uint off)
+{
+	struct dirent de;
+
+	memset(&de, 0, sizeof(de));
+	if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+		panic("dirunlink");
+	dcacheset(dp, name, 0, 0);
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -623,7 +1257,7 @@ namex(char *path, int nameiparent, char *name)
 	if(*path == '/')
 		ip = iget(ROOTDEV, ROOTINO);
 	else
-		ip = idup(myproc()->cwd);
+		ip = cwdget();
 
 	while((path = skipelem(path, name)) != 0){
 		ilock(ip);
@@ -3,7 +3,13 @@
 
 
 #define ROOTINO 1  // root i-number
-#define BSIZE 512  // block size
+
+// Block size: a multiple of the 512-byte sector, at most a page.
+// Chosen when building ("make BSIZE=512") and recorded in the
+// super block, which the kernel checks at mount.
+#ifndef BSIZE
+#define BSIZE 4096
+#endif
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
@@ -19,11 +25,16 @@ struct superblock {
 	uint logstart;     // Block number of first log block
 	uint inodestart;   // Block number of first inode block
 	uint bmapstart;    // Block number of first free map block
+	uint magic;        // Must be FSMAGIC
+	uint bsize;        // Block size (bytes)
 };
 
-#define NDIRECT 12
+#define FSMAGIC 0x10203040
+
+#define NDIRECT 11
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -32,7 +43,7 @@ struct dinode {
 	short minor;          // Minor device number (T_DEV only)
 	short nlink;          // Number of links to inode in file system
 	uint size;            // Size of file (bytes)
-	uint addrs[NDIRECT+1];   // Data block addresses
+	uint addrs[NDIRECT+2];   // Data block addresses
 };
 
 // Inodes per block.
@@ -55,3 +66,20 @@ struct dirent {
 	char name[DIRSIZ];
 };
 
+// Dirents per block
+#define DPB           (BSIZE / sizeof(struct dirent))
+
+// A directory whose dinode.major is DIRHASHED is an extendible
+// hash table.  Block 0 is the header and the other blocks are
+// buckets.  The first dirent of every block has inum 0, so
+// programs reading the directory skip it, and its name holds
+// the global depth (header) or the bucket's local depth.  The
+// rest of the header's dirents hold, in their name bytes, the
+// table of bucket block numbers indexed by the low global
+// depth bits of a name's hash; the rest of a bucket's dirents
+// are ordinary entries.  Small directories keep the plain
+// format, which is a sequence of dirents.
+#define DIRHASHED     1
+#define DIRTABPS      (DIRSIZ / sizeof(ushort))  // table entries per dirent
+#define DIRTABMAX     ((DPB - 1) * DIRTABPS)     // max table entries
+
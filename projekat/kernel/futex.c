@@ -0,0 +1,95 @@
+// Futexes: let user code sleep until a word in its memory changes.
+//
+// futex_wait(uaddr, val) sleeps if *uaddr still holds val, and
+// futex_wake(uaddr, n) wakes up to n processes sleeping on uaddr.
+// User code only makes these calls when it has to block, so a
+// synchronization primitive built on them costs no system calls
+// while it is uncontended.
+//
+// The sleep channel is the kernel address of the word, so it
+// names the physical memory rather than the user address: two
+// processes that map the same shared memory page at different
+// addresses still wait on the same channel.
+//
+// futexlock makes the check of *uaddr in futexwait() atomic
+// with respect to futexwake(): a waker that changes the word
+// and then calls futexwake() either runs before the check (and
+// the waiter doesn't sleep) or finds the waiter asleep.  The
+// check also holds the address-space lock, so that another
+// thread can't free the page under it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+static struct spinlock futexlock;
+
+void
+futexinit(void)
+{
+	initlock(&futexlock, "futex");
+}
+
+// Return the kernel address of the user word at uaddr in
+// the current process, or 0 if it isn't a valid user word.
+// A mapped file page is faulted in if need be.
+static int*
+futexaddr(uint uaddr)
+{
+	char *ka;
+
+	if(uaddr % sizeof(int) != 0 || uaddr >= KERNBASE)
+		return 0;
+	if(uaddr >= MMAPBASE && uaddr < SHMBASE && mmapfault(uaddr, 0) < 0)
+		return 0;
+	if((ka = uva2ka(myproc()->pgdir, (char*)PGROUNDDOWN(uaddr))) == 0)
+		return 0;
+	return (int*)(ka + uaddr % PGSIZE);
+}
+
+// Sleep on uaddr if it holds val.  Returns 0 after a wakeup
+// (which may be spurious, so callers recheck the word), and
+// -1 if the word didn't hold val or the process was killed.
+int
+futexwait(uint uaddr, int val)
+{
+	int *ka;
+
+	vmlock();
+	if((ka = futexaddr(uaddr)) == 0){
+		vmunlock();
+		return -1;
+	}
+
+	acquire(&futexlock);
+	if(*ka != val || myproc()->killed){
+		release(&futexlock);
+		vmunlock();
+		return -1;
+	}
+	vmunlock();
+	sleep(ka, &futexlock);
+	release(&futexlock);
+	return 0;
+}
+
+// Wake up at most n processes waiting on uaddr.
+// Returns the number of processes woken, or -1.
+int
+futexwake(uint uaddr, int n)
+{
+	int *ka;
+	int woken;
+
+	if((ka = futexaddr(uaddr)) == 0 || n < 0)
+		return -1;
+
+	acquire(&futexlock);
+	woken = wakeupn(ka, n);
+	release(&futexlock);
+	return woken;
+}
@@ -1,4 +1,5 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// Simple IDE driver code.  Uses bus-master DMA if the
+// controller supports it, and PIO otherwise.
 
 #include "types.h"
 #include "defs.h"
@@ -12,6 +13,10 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "stat.h"
+#include "pci.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
@@ -23,16 +28,67 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+#define IDE_CMD_RDDMA 0xc8
+#define IDE_CMD_WRDMA 0xca
+
+// Bus master registers for the primary channel, from BAR4
+#define BM_CMD        0
+#define BM_STATUS     2
+#define BM_PRDT       4
+#define BM_CMD_START  0x01
+#define BM_CMD_READ   0x08  // device to memory
+#define BM_ST_ERR     0x02
+#define BM_ST_INTR    0x04
+
+// Physical region descriptor: one piece of a DMA transfer.
+struct prd {
+	uint addr;
+	ushort len;
+	ushort flags;
+};
+#define PRD_EOT       0x8000  // last descriptor in the table
+
+#define IDEMULT     16  // sectors per interrupt in READ/WRITE MULTIPLE
+#define IDEMAXSECT 128  // sectors per command
+#define IDEDEADLINE 50  // ticks a request may wait before it goes first
 
 // idequeue points to the buf now being read/written to the disk.
 // idequeue->qnext points to the next buf to be processed.
 // You must hold idelock while manipulating queue.
+//
+// A run of bufs at the head of the queue that hold consecutive
+// blocks in the same direction is merged into one command; idecur
+// describes it.  With DMA, the controller moves the data straight
+// to or from the bufs and interrupts once at the end; with PIO,
+// ideintr() copies IDEMULT sectors per interrupt.
+//
+// The rest of the queue is kept in C-LOOK elevator order: the
+// requests at or past the end of the active command in ascending
+// block order, then those before it, also ascending, for the next
+// sweep.  A request that has waited IDEDEADLINE ticks is served
+// next wherever it is, so a busy region of the disk can't starve
+// the others.  idesched can switch back to plain FIFO order.
 
 static struct spinlock idelock;
 static struct buf *idequeue;
 
+static struct {
+	int nbuf;   // bufs at the head of idequeue in the command
+	int nsect;  // sectors in the command
+	int done;   // sectors transferred so far
+} idecur;
+
+static int idesched = DISK_CLOOK;
+static struct diskstat idestats;
+static uint idelast;  // sector after the last command
+
 static int havedisk1;
+int ideirq = IRQ_IDE;
+static int idebm;          // bus master I/O base, 0 to use PIO
+static struct prd *prdt;   // DMA descriptors for the active command
 static void idestart(struct buf*);
+static void ideexpire(void);
 
 // Wait for IDE disk to become ready.
 static int
@@ -47,13 +103,32 @@ idewait(int checkerr)
 	return 0;
 }
 
+// Look for a bus-master IDE controller (PIIX in QEMU) in
+// compatibility mode, and set it up for DMA if there is one.
+static void
+idedmainit(void)
+{
+	struct pcidev d;
+	uint bar;
+
+	if(pcifind(-1, -1, 0x01, 0x01, &d) < 0 || !(d.progif & 0x80) || (d.progif & 0x01))
+		return;
+	bar = pciread(&d, PCI_BAR0 + 4*4);
+	if(!(bar & 1) || (prdt = (struct prd*)kalloc()) == 0)
+		return;
+	pciwrite(&d, PCI_CMD, pciread(&d, PCI_CMD) | PCI_CMD_IO | PCI_CMD_MASTER);
+	idebm = bar & ~3;
+	outb(idebm + BM_CMD, 0);
+	outb(idebm + BM_STATUS, BM_ST_ERR|BM_ST_INTR);
+}
+
 void
 ideinit(void)
 {
 	int i;
 
 	initlock(&idelock, "ide");
-	ioapicenable(IRQ_IDE, ncpu - 1);
+	ioapicenable(ideirq, ncpu - 1);
 	idewait(0);
 
 	// Check if disk 1 is present
@@ -65,37 +140,103 @@ ideinit(void)
 		}
 	}
 
+	// Have each disk transfer IDEMULT sectors per interrupt
+	// in READ/WRITE MULTIPLE.
+	for(i=0; i<=havedisk1; i++){
+		outb(0x1f2, IDEMULT);
+		outb(0x1f6, 0xe0 | (i<<4));
+		outb(0x1f7, IDE_CMD_SETMUL);
+		idewait(0);
+	}
+
 	// Switch back to disk 0.
 	outb(0x1f6, 0xe0 | (0<<4));
+
+	idedmainit();
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Move n sectors, starting at sector i of the active
+// command, between the disk and the bufs.
+static void
+idexfer(int i, int n)
+{
+	struct buf *b;
+	int k;
+	int sector_per_block = BSIZE/SECTOR_SIZE;
+
+	for(; n > 0; i++, n--){
+		b = idequeue;
+		for(k = i/sector_per_block; k > 0; k--)
+			b = b->qnext;
+		if(b->flags & B_DIRTY)
+			outsl(0x1f0, b->data + (i%sector_per_block)*SECTOR_SIZE, SECTOR_SIZE/4);
+		else
+			insl(0x1f0, b->data + (i%sector_per_block)*SECTOR_SIZE, SECTOR_SIZE/4);
+	}
+}
+
+// Start the request for b, the head of idequeue, merged
+// with the bufs after it that continue it.
+// Caller must hold idelock.
 static void
 idestart(struct buf *b)
 {
+	struct buf *nb;
+	int i, n;
+
 	if(b == 0)
 		panic("idestart");
 	if(b->blockno >= FSSIZE)
 		panic("incorrect blockno");
 	int sector_per_block =  BSIZE/SECTOR_SIZE;
 	int sector = b->blockno * sector_per_block;
-	int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
-	int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
 
-	if (sector_per_block > 7) panic("idestart");
+	if (sector_per_block > IDEMAXSECT) panic("idestart");
+
+	n = 1;
+	for(nb = b->qnext; nb && (n+1)*sector_per_block <= IDEMAXSECT; nb = nb->qnext, n++){
+		if(nb->dev != b->dev || nb->blockno != b->blockno + n ||
+		   (nb->flags & B_DIRTY) != (b->flags & B_DIRTY))
+			break;
+	}
+	idecur.nbuf = n;
+	idecur.nsect = n * sector_per_block;
+	idecur.done = 0;
+
+	idestats.cmds++;
+	idestats.sectors += idecur.nsect;
+	idestats.seek += sector > idelast ? sector - idelast : idelast - sector;
+	idelast = sector + idecur.nsect;
+
+	// Give the controller the bufs' physical addresses.
+	if(idebm){
+		for(i = 0, nb = b; i < n; i++, nb = nb->qnext){
+			prdt[i].addr = V2P(nb->data);
+			prdt[i].len = BSIZE;
+			prdt[i].flags = 0;
+		}
+		prdt[n-1].flags = PRD_EOT;
+		outl(idebm + BM_PRDT, V2P(prdt));
+		outb(idebm + BM_CMD, (b->flags & B_DIRTY) ? 0 : BM_CMD_READ);
+		outb(idebm + BM_STATUS, BM_ST_ERR|BM_ST_INTR);
+	}
 
 	idewait(0);
 	outb(0x3f6, 0);  // generate interrupt
-	outb(0x1f2, sector_per_block);  // number of sectors
+	outb(0x1f2, idecur.nsect);  // number of sectors
 	outb(0x1f3, sector & 0xff);
 	outb(0x1f4, (sector >> 8) & 0xff);
 	outb(0x1f5, (sector >> 16) & 0xff);
 	outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
-	if(b->flags & B_DIRTY){
-		outb(0x1f7, write_cmd);
-		outsl(0x1f0, b->data, BSIZE/4);
+	if(idebm){
+		outb(0x1f7, (b->flags & B_DIRTY) ? IDE_CMD_WRDMA : IDE_CMD_RDDMA);
+		outb(idebm + BM_CMD, inb(idebm + BM_CMD) | BM_CMD_START);
+	} else if(b->flags & B_DIRTY){
+		outb(0x1f7, IDE_CMD_WRMUL);
+		idecur.done = min(IDEMULT, idecur.nsect);
+		idexfer(0, idecur.done);
 	} else {
-		outb(0x1f7, read_cmd);
+		outb(0x1f7, IDE_CMD_RDMUL);
 	}
 }
 
@@ -104,64 +245,182 @@ void
 ideintr(void)
 {
 	struct buf *b;
+	int i, n;
+	void (*done)(struct buf*);
 
-	// First queued buffer is the active request.
+	// First queued buffers are the active request.
 	acquire(&idelock);
 
 	if((b = idequeue) == 0){
 		release(&idelock);
 		return;
 	}
-	idequeue = b->qnext;
 
-	// Read data if needed.
-	if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-		insl(0x1f0, b->data, BSIZE/4);
+	if(idebm){
+		// The whole command is done, unless this
+		// interrupt isn't the controller's.
+		if(!(inb(idebm + BM_STATUS) & BM_ST_INTR)){
+			release(&idelock);
+			return;
+		}
+		outb(idebm + BM_CMD, 0);
+		if((inb(idebm + BM_STATUS) & BM_ST_ERR) || idewait(1) < 0)
+			panic("ideintr: dma error");
+		outb(idebm + BM_STATUS, BM_ST_ERR|BM_ST_INTR);
+	} else {
+		// Move the next chunk of sectors.  Reads get one ready
+		// per interrupt; writes ask for one per interrupt until
+		// the disk has taken them all.
+		n = min(IDEMULT, idecur.nsect - idecur.done);
+		if(!(b->flags & B_DIRTY)){
+			if(idewait(1) >= 0)
+				idexfer(idecur.done, n);
+			idecur.done += n;
+		} else if(n > 0){
+			idexfer(idecur.done, n);
+			idecur.done += n;
+			release(&idelock);
+			return;
+		}
+		if(idecur.done < idecur.nsect){
+			release(&idelock);
+			return;
+		}
+	}
+
+	for(i = 0; i < idecur.nbuf; i++){
+		b = idequeue;
+		idequeue = b->qnext;
 
-	// Wake process waiting for this buf.
-	b->flags |= B_VALID;
-	b->flags &= ~B_DIRTY;
-	wakeup(b);
+		// Wake process waiting for this buf, and tell
+		// whoever submitted it.
+		b->flags |= B_VALID;
+		b->flags &= ~B_DIRTY;
+		wakeup(b);
+		if((done = b->done) != 0){
+			b->done = 0;
+			done(b);
+		}
+	}
 
 	// Start disk on next buf in queue.
-	if(idequeue != 0)
+	if(idequeue != 0){
+		ideexpire();
 		idestart(idequeue);
+	}
 
 	release(&idelock);
 }
 
-// Sync buf with disk.
+// Move the queued request with the earliest deadline to the
+// head of the queue if its deadline has passed.  Called with
+// no command active.  Caller must hold idelock.
+static void
+ideexpire(void)
+{
+	struct buf *b, **pp, **oldest;
+
+	oldest = 0;
+	for(pp = &idequeue; *pp; pp = &(*pp)->qnext)
+		if(oldest == 0 || (int)((*pp)->deadline - (*oldest)->deadline) < 0)
+			oldest = pp;
+	if(oldest == &idequeue || (int)(ticks - (*oldest)->deadline) < 0)
+		return;
+	idestats.expired++;
+	b = *oldest;
+	*oldest = b->qnext;
+	b->qnext = idequeue;
+	idequeue = b;
+}
+
+// Does a go before b in an elevator sweep that is at pos?
+static int
+idebefore(struct buf *a, struct buf *b, uint pos)
+{
+	int wrapa = a->blockno < pos, wrapb = b->blockno < pos;
+
+	if(wrapa != wrapb)
+		return wrapb;
+	return a->blockno < b->blockno;
+}
+
+// Queue buf for the disk and return without waiting.
 // If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
 // Else if B_VALID is not set, read buf from disk, set B_VALID.
+// When the request completes, ideintr() wakes up processes in
+// ideawait() and calls b->done(b), if set, in interrupt context
+// with idelock held; done must not sleep or call back into the
+// driver.  Until then the submitter must keep b locked.
 void
-iderw(struct buf *b)
+idesubmit(struct buf *b)
 {
 	struct buf **pp;
+	uint pos;
+	int i;
 
 	if(!holdingsleep(&b->lock))
-		panic("iderw: buf not locked");
+		panic("idesubmit: buf not locked");
 	if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-		panic("iderw: nothing to do");
+		panic("idesubmit: nothing to do");
 	if(b->dev != 0 && !havedisk1)
-		panic("iderw: ide disk 1 not present");
+		panic("idesubmit: ide disk 1 not present");
 
 	acquire(&idelock);  //DOC:acquire-lock
 
-	// Append b to idequeue.
-	b->qnext = 0;
-	for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-		;
+	b->deadline = ticks + IDEDEADLINE;
+
+	// Insert b into idequeue, behind the active command.
+	pp = &idequeue;
+	pos = 0;
+	if(idequeue != 0){
+		for(i = 0; i < idecur.nbuf; i++){
+			pos = (*pp)->blockno + 1;
+			pp = &(*pp)->qnext;
+		}
+		for(; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
+			if(idesched == DISK_CLOOK && idebefore(b, *pp, pos))
+				break;
+	}
+	b->qnext = *pp;
 	*pp = b;
 
 	// Start disk if necessary.
 	if(idequeue == b)
 		idestart(b);
 
-	// Wait for request to finish.
+	release(&idelock);
+}
+
+// Wait for a request submitted without a done callback.
+void
+ideawait(struct buf *b)
+{
+	acquire(&idelock);
 	while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
 		sleep(b, &idelock);
 	}
+	release(&idelock);
+}
 
+// Sync buf with disk.
+void
+iderw(struct buf *b)
+{
+	idesubmit(b);
+	ideawait(b);
+}
 
+// Fill in *st with the disk statistics gathered since the last
+// call, and reset them.  If sched is DISK_FIFO or DISK_CLOOK,
+// switch the queue to that order.
+void
+idestat(struct diskstat *st, int sched)
+{
+	acquire(&idelock);
+	if(sched == DISK_FIFO || sched == DISK_CLOOK)
+		idesched = sched;
+	idestats.sched = idesched;
+	*st = idestats;
+	memset(&idestats, 0, sizeof(idestats));
 	release(&idelock);
 }
@@ -21,6 +21,7 @@ struct {
 	struct spinlock lock;
 	int use_lock;
 	struct run *freelist;
+	int nfree;         // pages on freelist
 } kmem;
 
 // Initialization happens in two phases.
@@ -72,6 +73,7 @@ kfree(char *v)
 	r = (struct run*)v;
 	r->next = kmem.freelist;
 	kmem.freelist = r;
+	kmem.nfree++;
 	if(kmem.use_lock)
 		release(&kmem.lock);
 }
@@ -79,18 +81,32 @@ kfree(char *v)
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
+// When memory runs out, takes pages back from the
+// block cache before giving up.
 char*
 kalloc(void)
 {
 	struct run *r;
 
-	if(kmem.use_lock)
-		acquire(&kmem.lock);
-	r = kmem.freelist;
-	if(r)
-		kmem.freelist = r->next;
-	if(kmem.use_lock)
-		release(&kmem.lock);
-	return (char*)r;
+	for(;;){
+		if(kmem.use_lock)
+			acquire(&kmem.lock);
+		r = kmem.freelist;
+		if(r){
+			kmem.freelist = r->next;
+			kmem.nfree--;
+		}
+		if(kmem.use_lock)
+			release(&kmem.lock);
+		if(r || !kmem.use_lock || !breclaim())
+			return (char*)r;
+	}
+}
+
+// Return the number of free pages.
+int
+kfreepages(void)
+{
+	return kmem.nfree;
 }
 
@@ -112,6 +112,17 @@ lapiceoi(void)
 		lapicw(EOI, 0);
 }
 
+// Send interrupt vec to the CPU with the given APIC ID.
+// Must be called with interrupts disabled.
+void
+lapicipi(uchar apicid, int vec)
+{
+	lapicw(ICRHI, apicid<<24);
+	lapicw(ICRLO, FIXED | vec);
+	while(lapic[ICRLO] & DELIVS)
+		;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
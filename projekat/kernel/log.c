@@ -16,9 +16,26 @@
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
+// the count of in-progress FS system calls, reserves
+// MAXOPBLOCKS blocks of the log and returns.
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
+// A call that writes more, like a big write(), reserves
+// up to log_maxop() blocks with begin_opn()/end_opn().
+//
+// The size of the log is set by mkfs in the superblock;
+// LOGSIZE only bounds it.
+//
+// Commits are group commits: the end_op() that leaves no FS
+// system calls active takes the open transaction, holding every
+// call that has ended since the last commit, and commits it.
+// New calls wait only while the committer copies the group's
+// blocks into log buffers; after that they go into the next
+// transaction while the group is written and installed.  When
+// the commit is done, the committer goes on with the next group
+// if it is complete by then.  So end_op() does not guarantee
+// that the call's updates are on disk; log_sync() (fsync())
+// waits until they are.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -27,7 +44,9 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// Log blocks and home locations are written with bawrite(), so
+// the disk works through a whole batch of them back to back;
+// commit() waits for each batch before writing the header.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -40,10 +59,18 @@ struct log {
 	struct spinlock lock;
 	int start;
 	int size;
+	int max;         // data blocks in the log
 	int outstanding; // how many FS sys calls are executing.
+	int reserved;    // blocks reserved by them
 	int committing;  // in commit(), please wait.
+	int copying;     // commit() is copying blocks to the log.
 	int dev;
-	struct logheader lh;
+	uint seq;        // number of the open transaction
+	uint synced;     // transactions up to this one are on disk
+	struct logheader lh;   // the open transaction
+	struct logheader clh;  // the transaction being committed
+	short hash[NLOGHASH];  // 1 + index in lh of a block, by block #
+	short hnext[LOGSIZE];  // next index+1 in the same bucket
 };
 struct log log;
 
@@ -61,24 +88,83 @@ initlog(int dev)
 	readsb(dev, &sb);
 	log.start = sb.logstart;
 	log.size = sb.nlog;
+	log.max = log.size - 1 < LOGSIZE ? log.size - 1 : LOGSIZE;
+	if (log.max < MAXOPBLOCKS)
+		panic("initlog: log too small");
 	log.dev = dev;
+	log.seq = 1;
 	recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
+// Wait for the writes started by bawrite() on blocks
+// start .. start+n-1 of the log (if block is 0) or on
+// the home locations of the first n logged blocks.
+static void
+log_wait(int start, int n, int *block)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		brelse(bread(log.dev, block ? block[i] : start+i));
+}
+
+// Return the index of blockno in the open transaction,
+// or -1.  Caller must hold log.lock.
+static int
+log_find(int blockno)
+{
+	int i;
+
+	for (i = log.hash[blockno % NLOGHASH]; i != 0; i = log.hnext[i-1])
+		if (log.lh.block[i-1] == blockno)
+			return i-1;
+	return -1;
+}
+
+// Is blockno part of the open transaction?
+static int
+log_open(int blockno)
+{
+	int r;
+
+	acquire(&log.lock);
+	r = log_find(blockno) >= 0;
+	release(&log.lock);
+	return r;
+}
+
+// Copy committed blocks from log to their home location.
+// After a crash the log blocks are the only copy.  Otherwise
+// the cached home blocks hold the committed data, unless
+// the open transaction has modified them since; those get
+// the committed data from the log written under them.
 static void
-install_trans(void)
+install_trans(int recovering)
 {
+	static uchar saved[BSIZE];
+	struct buf *lbuf, *dbuf;
 	int tail;
 
-	for (tail = 0; tail < log.lh.n; tail++) {
-		struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-		struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-		memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-		bwrite(dbuf);  // write dst to disk
-		brelse(lbuf);
-		brelse(dbuf);
+	for (tail = 0; tail < log.clh.n; tail++) {
+		dbuf = bread(log.dev, log.clh.block[tail]); // read dst
+		if (recovering) {
+			lbuf = bread(log.dev, log.start+tail+1); // read log block
+			memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
+			brelse(lbuf);
+		} else if (log_open(dbuf->blockno)) {
+			lbuf = bread(log.dev, log.start+tail+1);
+			memmove(saved, dbuf->data, BSIZE);
+			memmove(dbuf->data, lbuf->data, BSIZE);
+			brelse(lbuf);
+			bwrite(dbuf);
+			memmove(dbuf->data, saved, BSIZE);
+			dbuf->flags |= B_DIRTY;  // still pinned by the open transaction
+			brelse(dbuf);
+			continue;
+		}
+		bawrite(dbuf);  // start writing dst to disk
 	}
+	log_wait(0, log.clh.n, log.clh.block);
 }
 
 // Read the log header from disk into the in-memory log header
@@ -88,25 +174,24 @@ read_head(void)
 	struct buf *buf = bread(log.dev, log.start);
 	struct logheader *lh = (struct logheader *) (buf->data);
 	int i;
-	log.lh.n = lh->n;
-	for (i = 0; i < log.lh.n; i++) {
-		log.lh.block[i] = lh->block[i];
+	log.clh.n = lh->n;
+	for (i = 0; i < log.clh.n; i++) {
+		log.clh.block[i] = lh->block[i];
 	}
 	brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Write the header of the committing transaction to disk.
+// This is the true point at which the transaction commits.
 static void
 write_head(void)
 {
 	struct buf *buf = bread(log.dev, log.start);
 	struct logheader *hb = (struct logheader *) (buf->data);
 	int i;
-	hb->n = log.lh.n;
-	for (i = 0; i < log.lh.n; i++) {
-		hb->block[i] = log.lh.block[i];
+	hb->n = log.clh.n;
+	for (i = 0; i < log.clh.n; i++) {
+		hb->block[i] = log.clh.block[i];
 	}
 	bwrite(buf);
 	brelse(buf);
@@ -116,42 +201,62 @@ static void
 recover_from_log(void)
 {
 	read_head();
-	install_trans(); // if committed, copy from log to disk
-	log.lh.n = 0;
+	install_trans(1); // if committed, copy from log to disk
+	log.clh.n = 0;
 	write_head(); // clear the log
 }
 
-// called at the start of each FS system call.
+// The most blocks one FS system call may reserve.
+int
+log_maxop(void)
+{
+	return log.max/2 > MAXOPBLOCKS ? log.max/2 : MAXOPBLOCKS;
+}
+
+// called at the start of each FS system call
+// that may write up to n blocks.
 void
-begin_op(void)
+begin_opn(int n)
 {
+	if(n > log_maxop())
+		panic("begin_opn");
 	acquire(&log.lock);
 	while(1){
-		if(log.committing){
+		if(log.copying){
 			sleep(&log, &log.lock);
-		} else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+		} else if(log.lh.n + log.reserved + n > log.max){
 			// this op might exhaust log space; wait for commit.
 			sleep(&log, &log.lock);
 		} else {
 			log.outstanding += 1;
+			log.reserved += n;
 			release(&log.lock);
 			break;
 		}
 	}
 }
 
-// called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// called at the start of each FS system call.
 void
-end_op(void)
+begin_op(void)
+{
+	begin_opn(MAXOPBLOCKS);
+}
+
+// called at the end of each FS system call
+// started with begin_opn(n).
+// commits if this was the last outstanding operation
+// and no commit is under way; otherwise the committer
+// takes this operation with the next group.
+void
+end_opn(int n)
 {
 	int do_commit = 0;
 
 	acquire(&log.lock);
 	log.outstanding -= 1;
-	if(log.committing)
-		panic("log.committing");
-	if(log.outstanding == 0){
+	log.reserved -= n;
+	if(log.outstanding == 0 && !log.committing && log.lh.n > 0){
 		do_commit = 1;
 		log.committing = 1;
 	} else {
@@ -166,39 +271,82 @@ end_op(void)
 		// call commit w/o holding locks, since not allowed
 		// to sleep with locks.
 		commit();
-		acquire(&log.lock);
-		log.committing = 0;
-		wakeup(&log);
-		release(&log.lock);
 	}
 }
 
-// Copy modified blocks from cache to log.
+// called at the end of each FS system call.
+void
+end_op(void)
+{
+	end_opn(MAXOPBLOCKS);
+}
+
+// Wait until the FS system calls that have ended
+// so far are on disk.
+void
+log_sync(void)
+{
+	uint seq;
+
+	acquire(&log.lock);
+	seq = log.lh.n > 0 ? log.seq : log.seq - 1;
+	while((int)(log.synced - seq) < 0)
+		sleep(&log, &log.lock);
+	release(&log.lock);
+}
+
+// Copy modified blocks from cache to log,
+// and start writing them.
 static void
 write_log(void)
 {
 	int tail;
 
-	for (tail = 0; tail < log.lh.n; tail++) {
-		struct buf *to = bread(log.dev, log.start+tail+1); // log block
-		struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
+	for (tail = 0; tail < log.clh.n; tail++) {
+		struct buf *to = bgetnew(log.dev, log.start+tail+1); // log block
+		struct buf *from = bread(log.dev, log.clh.block[tail]); // cache block
 		memmove(to->data, from->data, BSIZE);
-		bwrite(to);  // write the log
 		brelse(from);
-		brelse(to);
+		bawrite(to);  // start writing the log
 	}
 }
 
+// Commit groups of transactions for as long as a
+// complete one is waiting.  Called with log.committing set.
 static void
 commit()
 {
-	if (log.lh.n > 0) {
-		write_log();     // Write modified blocks from cache to log
-		write_head();    // Write header to disk -- the real commit
-		install_trans(); // Now install writes to home locations
+	uint seq;
+
+	acquire(&log.lock);
+	while(log.outstanding == 0 && log.lh.n > 0){
+		log.clh = log.lh;
 		log.lh.n = 0;
+		memset(log.hash, 0, sizeof(log.hash));
+		seq = log.seq++;
+		log.copying = 1;
+		release(&log.lock);
+
+		write_log();     // Copy modified blocks from cache to log
+
+		acquire(&log.lock);
+		log.copying = 0;
+		wakeup(&log);    // Later ops go into the next transaction
+		release(&log.lock);
+
+		log_wait(log.start+1, log.clh.n, 0);
+		write_head();    // Write header to disk -- the real commit
+		install_trans(0); // Now install writes to home locations
+		log.clh.n = 0;
 		write_head();    // Erase the transaction from the log
+
+		acquire(&log.lock);
+		log.synced = seq;
+		wakeup(&log);
 	}
+	log.committing = 0;
+	wakeup(&log);
+	release(&log.lock);
 }
 
 // Caller has modified b->data and is done with the buffer.
@@ -215,19 +363,18 @@ log_write(struct buf *b)
 {
 	int i;
 
-	if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
-		panic("too big a transaction");
 	if (log.outstanding < 1)
 		panic("log_write outside of trans");
 
 	acquire(&log.lock);
-	for (i = 0; i < log.lh.n; i++) {
-		if (log.lh.block[i] == b->blockno)   // log absorbtion
-			break;
+	if ((i = log_find(b->blockno)) < 0) {  // log absorbtion
+		if (log.lh.n >= log.max)
+			panic("too big a transaction");
+		i = log.lh.n++;
+		log.lh.block[i] = b->blockno;
+		log.hnext[i] = log.hash[b->blockno % NLOGHASH];
+		log.hash[b->blockno % NLOGHASH] = i+1;
 	}
-	log.lh.block[i] = b->blockno;
-	if (i == log.lh.n)
-		log.lh.n++;
 	b->flags |= B_DIRTY; // prevent eviction
 	release(&log.lock);
 }
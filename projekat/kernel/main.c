@@ -30,6 +30,10 @@ main(void)
 	tvinit();        // trap vectors
 	binit();         // buffer cache
 	fileinit();      // file table
+	pollinit();      // poll() wait queues
+	shminit();       // shared memory objects
+	futexinit();     // user-space wait channels
+	mmapinit();      // memory-mapped files
 	ideinit();       // disk
 	startothers();   // start other processors
 	kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
@@ -12,11 +12,13 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "stat.h"
 
 extern uchar _binary_fs_img_start[], _binary_fs_img_size[];
 
 static int disksize;
 static uchar *memdisk;
+int ideirq = IRQ_IDE;
 
 void
 ideinit(void)
@@ -35,19 +37,21 @@ ideintr(void)
 // Sync buf with disk.
 // If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
 // Else if B_VALID is not set, read buf from disk, set B_VALID.
+// The memory disk is synchronous, so b->done is called at once.
 void
-iderw(struct buf *b)
+idesubmit(struct buf *b)
 {
 	uchar *p;
+	void (*done)(struct buf*);
 
 	if(!holdingsleep(&b->lock))
-		panic("iderw: buf not locked");
+		panic("idesubmit: buf not locked");
 	if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-		panic("iderw: nothing to do");
+		panic("idesubmit: nothing to do");
 	if(b->dev != 1)
-		panic("iderw: request not for disk 1");
+		panic("idesubmit: request not for disk 1");
 	if(b->blockno >= disksize)
-		panic("iderw: block out of range");
+		panic("idesubmit: block out of range");
 
 	p = memdisk + b->blockno*BSIZE;
 
@@ -57,4 +61,25 @@ iderw(struct buf *b)
 	} else
 		memmove(b->data, p, BSIZE);
 	b->flags |= B_VALID;
+	if((done = b->done) != 0){
+		b->done = 0;
+		done(b);
+	}
+}
+
+void
+ideawait(struct buf *b)
+{
+}
+
+void
+iderw(struct buf *b)
+{
+	idesubmit(b);
+}
+
+void
+idestat(struct diskstat *st, int sched)
+{
+	memset(st, 0, sizeof(*st));
 }
@@ -0,0 +1,404 @@
+// Memory-mapped files.
+//
+// mmap() reserves a range of addresses in [MMAPBASE, SHMBASE)
+// and records it in a VMA in p->vma[] of the thread group leader.
+// Nothing is read until the process touches a page; trap() then
+// calls mmapfault(), which reads the page in and maps it.
+//
+// Pages of MAP_SHARED mappings come from a small cache keyed by
+// inode and file offset, so every process that maps the same part
+// of a file sees the same physical page.  A page that a process
+// has written (PTE_D) is written back to the file through the log
+// when that process unmaps it; write-back never grows the file.
+// MAP_PRIVATE pages are private copies and are never written back.
+//
+// There is no msync(): dirty MAP_SHARED pages reach the file only
+// when they are unmapped by munmap(), exec() or exit().  write()
+// does not update pages that are already mapped.  Mapped memory can
+// be handed to system calls; argptr() faults its pages in first.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "stat.h"
+#include "fcntl.h"
+
+struct mpage {
+	struct inode *ip;  // File the page belongs to, 0 if slot is free
+	uint off;          // Offset of the page in the file
+	char *pa;          // Kernel address of the page
+	int ref;           // Number of PTEs mapping it
+};
+
+// The lock serializes all changes to VMAs and mapped pages.
+struct {
+	struct sleeplock lock;
+	struct mpage page[NMPAGE];
+} mcache;
+
+void
+mmapinit(void)
+{
+	initsleeplock(&mcache.lock, "mmap");
+}
+
+// Read the page of ip at off into a new page.
+// The part past the end of the file reads as zeros.
+static char*
+readpage(struct inode *ip, uint off)
+{
+	char *mem;
+
+	if((mem = kalloc()) == 0)
+		return 0;
+	memset(mem, 0, PGSIZE);
+	ilock(ip);
+	readi(ip, mem, off, PGSIZE);
+	iunlock(ip);
+	return mem;
+}
+
+// Write the page at pa back to ip at off, stopping at the
+// end of the file.  Like filewrite(), write a few blocks
+// per transaction to stay within the log.
+static void
+writepage(struct inode *ip, uint off, char *pa)
+{
+	int nop = log_maxop();
+	int max = ((nop-1-3-2) / 2) * BSIZE;
+	uint i, n, len;
+
+	ilock(ip);
+	len = ip->size > off ? ip->size - off : 0;
+	iunlock(ip);
+	if(len > PGSIZE)
+		len = PGSIZE;
+
+	for(i = 0; i < len; i += n){
+		n = len - i;
+		if(n > max)
+			n = max;
+		begin_opn(nop);
+		ilock(ip);
+		writei(ip, pa + i, off + i, n);
+		iunlock(ip);
+		end_opn(nop);
+	}
+}
+
+// Return the cached page of ip at off with a new reference,
+// reading it in if it isn't cached.  Returns 0 on failure.
+static char*
+mpageget(struct inode *ip, uint off)
+{
+	struct mpage *m, *empty;
+
+	empty = 0;
+	for(m = mcache.page; m < &mcache.page[NMPAGE]; m++){
+		if(m->ip == ip && m->off == off){
+			m->ref++;
+			return m->pa;
+		}
+		if(m->ip == 0 && empty == 0)
+			empty = m;
+	}
+	if(empty == 0 || (empty->pa = readpage(ip, off)) == 0)
+		return 0;
+	empty->ip = ip;
+	empty->off = off;
+	empty->ref = 1;
+	return empty->pa;
+}
+
+// Find the cached page at kernel address pa.
+static struct mpage*
+mpagefind(char *pa)
+{
+	struct mpage *m;
+
+	for(m = mcache.page; m < &mcache.page[NMPAGE]; m++)
+		if(m->ip && m->pa == pa)
+			return m;
+	panic("mpagefind");
+}
+
+// Drop a reference to the cached page at pa.
+static void
+mpageput(char *pa)
+{
+	struct mpage *m;
+
+	m = mpagefind(pa);
+	if(--m->ref == 0){
+		kfree(m->pa);
+		m->ip = 0;
+		m->pa = 0;
+	}
+}
+
+static int
+vmaperm(struct vma *v)
+{
+	if(v->prot & PROT_WRITE)
+		return PTE_U|PTE_W;
+	return PTE_U;
+}
+
+// Find the VMA of p containing va.
+static struct vma*
+vmafind(struct proc *p, uint va)
+{
+	struct vma *v;
+
+	for(v = p->vma; v < &p->vma[NVMA]; v++)
+		if(v->start && v->start <= va && va < v->end)
+			return v;
+	return 0;
+}
+
+// Find len unused bytes in the mmap region of p.
+// Returns the start address, or 0.
+static uint
+findgap(struct proc *p, uint len)
+{
+	struct vma *v;
+	uint start;
+
+	for(start = MMAPBASE; start + len <= SHMBASE; start = v->end){
+		for(v = p->vma; v < &p->vma[NVMA]; v++)
+			if(v->start && v->start < start + len && start < v->end)
+				break;
+		if(v == &p->vma[NVMA])
+			return start;
+	}
+	return 0;
+}
+
+// Remove the pages of v in [start, end) from p's page table,
+// writing back the shared pages that p has dirtied.  The pages
+// are unmapped and flushed from every CPU's TLB before they are
+// written back and released, so no thread can still reach them.
+static void
+unmaprange(struct proc *p, struct vma *v, uint start, uint end)
+{
+	pte_t *pte;
+	char *pa;
+	uint va;
+
+	for(va = start; va < end; va += PGSIZE){
+		pte = walkpgdir(p->pgdir, (char*)va, 0);
+		if(pte != 0 && (*pte & PTE_P))
+			*pte = (*pte & ~PTE_P) | PTE_ZAP;
+	}
+	tlbshootdown(p->pgdir);
+
+	for(va = start; va < end; va += PGSIZE){
+		pte = walkpgdir(p->pgdir, (char*)va, 0);
+		if(pte == 0 || (*pte & PTE_ZAP) == 0)
+			continue;
+		pa = P2V(PTE_ADDR(*pte));
+		if(v->flags == MAP_SHARED){
+			if(*pte & PTE_D)
+				writepage(v->f->ip, v->off + (va - v->start), pa);
+			mpageput(pa);
+		} else
+			kfree(pa);
+		*pte = 0;
+	}
+}
+
+// Map len bytes of f, starting at offset off, which must be
+// page-aligned.  Returns the address of the mapping, or -1.
+int
+mmap(struct file *f, uint off, int len, int prot, int flags)
+{
+	struct proc *p = myproc()->leader;
+	struct vma *v;
+	uint start;
+	short type;
+
+	if(f->type != FD_INODE || off % PGSIZE != 0 || len <= 0 ||
+	   len > SHMBASE - MMAPBASE)
+		return -1;
+	if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+		return -1;
+	if(!f->readable || (flags == MAP_SHARED && (prot & PROT_WRITE) && !f->writable))
+		return -1;
+	ilock(f->ip);
+	type = f->ip->type;
+	iunlock(f->ip);
+	if(type != T_FILE)
+		return -1;
+	len = PGROUNDUP(len);
+
+	acquiresleep(&mcache.lock);
+	for(v = p->vma; v < &p->vma[NVMA]; v++)
+		if(v->start == 0)
+			break;
+	if(v == &p->vma[NVMA] || (start = findgap(p, len)) == 0){
+		releasesleep(&mcache.lock);
+		return -1;
+	}
+	v->start = start;
+	v->end = start + len;
+	v->f = filedup(f);
+	v->off = off;
+	v->prot = prot;
+	v->flags = flags;
+	releasesleep(&mcache.lock);
+	return start;
+}
+
+// Unmap [addr, addr+len), which must lie in one mapping and
+// include its first or its last page.  Returns 0, or -1.
+int
+munmap(uint addr, int len)
+{
+	struct proc *p = myproc()->leader;
+	struct vma *v;
+	uint end;
+
+	if(addr % PGSIZE != 0 || len <= 0)
+		return -1;
+	end = addr + PGROUNDUP(len);
+
+	vmlock();
+	acquiresleep(&mcache.lock);
+	if((v = vmafind(p, addr)) == 0 || end > v->end || end <= addr ||
+	   (addr != v->start && end != v->end)){
+		releasesleep(&mcache.lock);
+		vmunlock();
+		return -1;
+	}
+	unmaprange(p, v, addr, end);
+	if(addr == v->start && end == v->end){
+		fileclose(v->f);
+		memset(v, 0, sizeof(*v));
+	} else if(addr == v->start){
+		v->off += end - v->start;
+		v->start = end;
+	} else
+		v->end = addr;
+	releasesleep(&mcache.lock);
+	vmunlock();
+	return 0;
+}
+
+// Handle a page fault at va in the current process by mapping
+// the file page there, if the access is allowed.  Returns 0 if
+// the faulting instruction can be restarted, -1 otherwise.
+int
+mmapfault(uint va, uint err)
+{
+	struct proc *p = myproc()->leader;
+	struct vma *v;
+	pte_t *pte;
+	char *pa;
+	uint off;
+
+	if(va < MMAPBASE || va >= SHMBASE)
+		return -1;
+	va = PGROUNDDOWN(va);
+
+	acquiresleep(&mcache.lock);
+	if((v = vmafind(p, va)) == 0 || ((err & FEC_WR) && !(v->prot & PROT_WRITE)))
+		goto bad;
+	// Another thread may have mapped the page meanwhile.
+	pte = walkpgdir(p->pgdir, (char*)va, 0);
+	if(pte && (*pte & PTE_P)){
+		releasesleep(&mcache.lock);
+		return 0;
+	}
+
+	off = v->off + (va - v->start);
+	if(v->flags == MAP_SHARED)
+		pa = mpageget(v->f->ip, off);
+	else
+		pa = readpage(v->f->ip, off);
+	if(pa == 0)
+		goto bad;
+	if(mapshared(p->pgdir, va, &pa, 1, vmaperm(v)) < 0){
+		if(v->flags == MAP_SHARED)
+			mpageput(pa);
+		else
+			kfree(pa);
+		goto bad;
+	}
+	releasesleep(&mcache.lock);
+	return 0;
+
+bad:
+	releasesleep(&mcache.lock);
+	return -1;
+}
+
+// Give child np p's mappings: shared pages are mapped in both,
+// private pages are copied.  Returns 0 on success, -1 on failure
+// (the caller should mmapcloseall(np)).
+int
+mmapfork(struct proc *np, struct proc *p)
+{
+	struct vma *v, *nv;
+	pte_t *pte;
+	char *pa;
+	uint va;
+
+	acquiresleep(&mcache.lock);
+	for(v = p->vma, nv = np->vma; v < &p->vma[NVMA]; v++, nv++){
+		if(v->start == 0)
+			continue;
+		*nv = *v;
+		filedup(nv->f);
+		for(va = v->start; va < v->end; va += PGSIZE){
+			pte = walkpgdir(p->pgdir, (char*)va, 0);
+			if(pte == 0 || (*pte & PTE_P) == 0)
+				continue;
+			pa = P2V(PTE_ADDR(*pte));
+			if(v->flags == MAP_SHARED)
+				mpagefind(pa)->ref++;
+			else {
+				if((pa = kalloc()) == 0)
+					goto bad;
+				memmove(pa, P2V(PTE_ADDR(*pte)), PGSIZE);
+			}
+			if(mapshared(np->pgdir, va, &pa, 1, vmaperm(v)) < 0){
+				if(v->flags == MAP_SHARED)
+					mpageput(pa);
+				else
+					kfree(pa);
+				goto bad;
+			}
+		}
+	}
+	releasesleep(&mcache.lock);
+	return 0;
+
+bad:
+	releasesleep(&mcache.lock);
+	return -1;
+}
+
+// Unmap all of p's mappings.  Called from exec() and exit(),
+// before p's pgdir is freed.
+void
+mmapcloseall(struct proc *p)
+{
+	struct vma *v;
+
+	acquiresleep(&mcache.lock);
+	for(v = p->vma; v < &p->vma[NVMA]; v++){
+		if(v->start == 0)
+			continue;
+		unmaprange(p, v, v->start, v->end);
+		fileclose(v->f);
+		memset(v, 0, sizeof(*v));
+	}
+	releasesleep(&mcache.lock);
+}
@@ -3,12 +3,27 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // minimum size of the i-node cache
+#define NINODEMAX  4096  // maximum size of the i-node cache
+#define NIHASH      251  // buckets in the i-node cache
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
-#define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define MAXOPBLOCKS  20  // max # of blocks most FS ops write
+#define LOGSIZE     126  // max data blocks in on-disk log
+#define NLOGHASH     61  // buckets for finding blocks in the log
+#define NBUF         (LOGSIZE*3+MAXOPBLOCKS*3)  // minimum size of disk block cache
+#define NBUFMAX    4096  // maximum size of disk block cache
+#define BMINFREE    256  // free pages below which the block cache shrinks
+#define NRAHEAD      16  // blocks to read ahead of sequential reads
+#define NPREALLOC    64  // blocks between the starts of new files
+#define NDCACHE     128  // directory lookup cache entries
+#define NDHASH       61  // buckets in the directory lookup cache
+#define FSSIZE       4000  // size of file system in blocks
+#define NSHM         16  // maximum number of shared memory objects
+#define NOSHM         8  // open shared memory objects per process
+#define SHMMAXPG     64  // maximum pages in a shared memory object
+#define SHMNAME      16  // maximum shared memory object name length
+#define NVMA         16  // memory-mapped regions per process
+#define NMPAGE      256  // maximum file pages in MAP_SHARED mappings
 
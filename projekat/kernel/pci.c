@@ -0,0 +1,61 @@
+// PCI configuration space access through the legacy
+// 0xCF8/0xCFC ports, and a simple device scan.
+
+#include "types.h"
+#include "defs.h"
+#include "x86.h"
+#include "pci.h"
+
+#define PCI_CONFADDR 0xCF8
+#define PCI_CONFDATA 0xCFC
+
+uint
+pciread(struct pcidev *d, int off)
+{
+	outl(PCI_CONFADDR, 0x80000000 | (d->bus<<16) | (d->dev<<11) |
+	     (d->func<<8) | (off & 0xFC));
+	return inl(PCI_CONFDATA);
+}
+
+void
+pciwrite(struct pcidev *d, int off, uint v)
+{
+	outl(PCI_CONFADDR, 0x80000000 | (d->bus<<16) | (d->dev<<11) |
+	     (d->func<<8) | (off & 0xFC));
+	outl(PCI_CONFDATA, v);
+}
+
+// Find the first function that matches vendor, device, class
+// and subclass, where -1 matches anything.  Fills in *d and
+// returns 0, or returns -1 if there is no such function.
+int
+pcifind(int vendor, int device, int class, int subclass, struct pcidev *d)
+{
+	uint id, cl;
+	int nfunc;
+
+	for(d->bus = 0; d->bus < 256; d->bus++){
+		for(d->dev = 0; d->dev < 32; d->dev++){
+			nfunc = 1;
+			for(d->func = 0; d->func < nfunc; d->func++){
+				if((id = pciread(d, PCI_ID)) == 0xFFFFFFFF)
+					continue;
+				if(d->func == 0 && (pciread(d, PCI_HEADER) & 0x800000))
+					nfunc = 8;  // multi-function device
+				cl = pciread(d, PCI_CLASS);
+				d->vendor = id & 0xFFFF;
+				d->device = id >> 16;
+				d->class = cl >> 24;
+				d->subclass = (cl >> 16) & 0xFF;
+				d->progif = (cl >> 8) & 0xFF;
+				d->irq = pciread(d, PCI_INTR) & 0xFF;
+				if((vendor < 0 || vendor == d->vendor) &&
+				   (device < 0 || device == d->device) &&
+				   (class < 0 || class == d->class) &&
+				   (subclass < 0 || subclass == d->subclass))
+					return 0;
+			}
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,25 @@
+// PCI function, as found by pcifind().
+struct pcidev {
+	int bus;
+	int dev;
+	int func;
+	ushort vendor;
+	ushort device;
+	uchar class;
+	uchar subclass;
+	uchar progif;
+	uchar irq;        // legacy interrupt line
+};
+
+// Configuration space registers
+#define PCI_ID        0x00
+#define PCI_CMD       0x04
+#define PCI_CLASS     0x08
+#define PCI_HEADER    0x0C
+#define PCI_BAR0      0x10
+#define PCI_INTR      0x3C
+
+// PCI_CMD bits
+#define PCI_CMD_IO     0x1  // respond to I/O space accesses
+#define PCI_CMD_MEM    0x2  // respond to memory space accesses
+#define PCI_CMD_MASTER 0x4  // allow bus mastering (DMA)
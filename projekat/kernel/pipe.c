@@ -7,18 +7,46 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "fcntl.h"
 
-#define PIPESIZE 512
+#define PIPEMAXPG 16    // most data pages in a pipe
+#define PIPELOAN PGSIZE  // smallest remainder of a write to loan
 
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+// The pipe's data is a ring of npage whole pages, one to start
+// with; pipesize() changes the number.  npage is a power of two,
+// so nread and nwrite may wrap around.  Data is copied in and
+// out in runs that end at page boundaries, so a one-page pipe
+// takes at most two memmoves per transfer.  Readers are woken
+// only when the ring stops being empty, and writers only when
+// it stops being full.
+//
+// A write first fills whatever room the ring has.  If at least
+// PIPELOAN bytes of it still don't fit, they are loaned to the
+// pipe instead: the writer leaves its address space and buffer in
+// lpgdir/laddr/lleft and sleeps, and readers copy straight from
+// its pages once the ring is empty, so the data is copied once
+// instead of twice.  Only one write is on loan at a time, and no
+// ring writes happen while it is, so the order of the bytes is
+// kept.
 struct pipe {
 	struct spinlock lock;
-	char data[PIPESIZE];
+	char *page[PIPEMAXPG];
+	uint npage;
 	uint nread;     // number of bytes read
 	uint nwrite;    // number of bytes written
 	int readopen;   // read fd is still open
 	int writeopen;  // write fd is still open
+	pde_t *lpgdir;  // page table of the loaning writer
+	uint laddr;     // next loaned byte, in lpgdir
+	int lleft;      // loaned bytes not yet read
+	struct pollent *rpoll;  // poll() waiting to read
+	struct pollent *wpoll;  // poll() waiting to write
 };
 
+#define PIPESIZE(p) ((p)->npage * PGSIZE)
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -30,10 +58,16 @@ pipealloc(struct file **f0, struct file **f1)
 		goto bad;
 	if((p = (struct pipe*)kalloc()) == 0)
 		goto bad;
+	if((p->page[0] = kalloc()) == 0)
+		goto bad;
+	p->npage = 1;
 	p->readopen = 1;
 	p->writeopen = 1;
 	p->nwrite = 0;
 	p->nread = 0;
+	p->lleft = 0;
+	p->rpoll = 0;
+	p->wpoll = 0;
 	initlock(&p->lock, "pipe");
 	(*f0)->type = FD_PIPE;
 	(*f0)->readable = 1;
@@ -55,6 +89,15 @@ pipealloc(struct file **f0, struct file **f1)
 	return -1;
 }
 
+static void
+freepages(char **page, int n)
+{
+	int i;
+
+	for(i = 0; i < n; i++)
+		kfree(page[i]);
+}
+
 void
 pipeclose(struct pipe *p, int writable)
 {
@@ -62,35 +105,155 @@ pipeclose(struct pipe *p, int writable)
 	if(writable){
 		p->writeopen = 0;
 		wakeup(&p->nread);
+		pollwakeup(&p->rpoll);
 	} else {
 		p->readopen = 0;
 		wakeup(&p->nwrite);
+		pollwakeup(&p->wpoll);
 	}
 	if(p->readopen == 0 && p->writeopen == 0){
 		release(&p->lock);
+		freepages(p->page, p->npage);
 		kfree((char*)p);
 	} else
 		release(&p->lock);
 }
 
+// Copy n bytes between buf and the ring of the npage pages in
+// page, starting at byte off of the ring; into the ring if in
+// is set, out of it otherwise.
+static void
+ringcopy(char **page, uint npage, uint off, char *buf, int n, int in)
+{
+	char *a;
+	int m;
+
+	for(; n > 0; off += m, buf += m, n -= m){
+		a = page[(off / PGSIZE) % npage] + off % PGSIZE;
+		m = min(n, PGSIZE - off % PGSIZE);
+		if(in)
+			memmove(a, buf, m);
+		else
+			memmove(buf, a, m);
+	}
+}
+
+// Make the ring hold n bytes, rounded up to a power of two
+// pages, and return its new size.  The ring can't shrink below
+// the data in it.  n == 0 just returns the size.
+int
+piperesize(struct pipe *p, int n)
+{
+	char *page[PIPEMAXPG], *old[PIPEMAXPG];
+	uint i, npage, oldnpage, cnt;
+
+	if(n < 0 || n > PIPEMAXPG*PGSIZE)
+		return -1;
+	if(n == 0)
+		return PIPESIZE(p);
+	for(npage = 1; npage*PGSIZE < n; npage *= 2)
+		;
+	for(i = 0; i < npage; i++){
+		if((page[i] = kalloc()) == 0){
+			freepages(page, i);
+			return -1;
+		}
+	}
+
+	acquire(&p->lock);
+	cnt = p->nwrite - p->nread;
+	if(cnt > npage*PGSIZE){
+		release(&p->lock);
+		freepages(page, npage);
+		return -1;
+	}
+	// Move the data to the start of the new ring.
+	for(i = 0; i < cnt; i += PGSIZE)
+		ringcopy(p->page, p->npage, p->nread + i, page[i/PGSIZE],
+			min(PGSIZE, cnt - i), 0);
+	oldnpage = p->npage;
+	memmove(old, p->page, oldnpage*sizeof(char*));
+	memmove(p->page, page, npage*sizeof(char*));
+	p->npage = npage;
+	p->nread = 0;
+	p->nwrite = cnt;
+	wakeup(&p->nwrite);
+	pollwakeup(&p->wpoll);
+	release(&p->lock);
+
+	freepages(old, oldnpage);
+	return npage*PGSIZE;
+}
+
+// Can the n bytes at user address addr be loaned?  The pages
+// must stay mapped while the writer sleeps, so the writer may
+// not share them with threads that could unmap them.
+static int
+canloan(char *addr, int n)
+{
+	struct proc *curproc = myproc();
+	uint a;
+
+	if(n < PIPELOAN || vmshared(curproc))
+		return 0;
+	for(a = PGROUNDDOWN((uint)addr); a < (uint)addr + n; a += PGSIZE)
+		if(uva2ka(curproc->pgdir, (char*)a) == 0)
+			return 0;
+	return 1;
+}
+
+// Loan the n bytes at addr to the readers and wait until they
+// have all been read.  Caller holds p->lock; no loan is active.
+static int
+pipeloan(struct pipe *p, char *addr, int n)
+{
+	p->lpgdir = myproc()->pgdir;
+	p->laddr = (uint)addr;
+	p->lleft = n;
+	wakeup(&p->nread);
+	pollwakeup(&p->rpoll);
+	while(p->lleft > 0){
+		if(p->readopen == 0 || myproc()->killed){
+			p->lleft = 0;
+			wakeup(&p->nwrite);
+			pollwakeup(&p->wpoll);
+			release(&p->lock);
+			return -1;
+		}
+		sleep(&p->nwrite, &p->lock);
+	}
+	release(&p->lock);
+	return n;
+}
+
 int
 pipewrite(struct pipe *p, char *addr, int n)
 {
-	int i;
+	int i, m, loan;
 
+	loan = canloan(addr, n);
 	acquire(&p->lock);
-	for(i = 0; i < n; i++){
-		while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
+	for(i = 0; i < n; i += m){
+		while(p->nwrite == p->nread + PIPESIZE(p) || p->lleft > 0){  //DOC: pipewrite-full
 			if(p->readopen == 0 || myproc()->killed){
 				release(&p->lock);
 				return -1;
 			}
-			wakeup(&p->nread);
 			sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
 		}
-		p->data[p->nwrite++ % PIPESIZE] = addr[i];
+		m = min(n - i, p->nread + PIPESIZE(p) - p->nwrite);
+		ringcopy(p->page, p->npage, p->nwrite, addr + i, m, 1);
+		if(p->nwrite == p->nread){
+			wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+			pollwakeup(&p->rpoll);
+		}
+		p->nwrite += m;
+		if(loan && n - i - m >= PIPELOAN){
+			if(pipeloan(p, addr + i + m, n - i - m) < 0)
+				return -1;
+			return n;
+		}
 	}
-	wakeup(&p->nread);  //DOC: pipewrite-wakeup1
 	release(&p->lock);
 	return n;
 }
@@ -98,22 +261,68 @@ pipewrite(struct pipe *p, char *addr, int n)
 int
 piperead(struct pipe *p, char *addr, int n)
 {
-	int i;
+	int i, m;
+	char *ka;
 
 	acquire(&p->lock);
-	while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
+	while(p->nread == p->nwrite && p->lleft == 0 && p->writeopen){  //DOC: pipe-empty
 		if(myproc()->killed){
 			release(&p->lock);
 			return -1;
 		}
 		sleep(&p->nread, &p->lock); //DOC: piperead-sleep
 	}
-	for(i = 0; i < n; i++){  //DOC: piperead-copy
-		if(p->nread == p->nwrite)
-			break;
-		addr[i] = p->data[p->nread++ % PIPESIZE];
+	i = min(n, p->nwrite - p->nread);  //DOC: piperead-copy
+	if(i > 0){
+		ringcopy(p->page, p->npage, p->nread, addr, i, 0);
+		if(p->nwrite == p->nread + PIPESIZE(p)){
+			wakeup(&p->nwrite);  //DOC: piperead-wakeup
+			pollwakeup(&p->wpoll);
+		}
+		p->nread += i;
+	}
+	if(i < n && p->lleft > 0){
+		for(; i < n && p->lleft > 0; i += m){
+			// canloan() checked the pages, and they stay
+			// mapped until the writer has been woken.
+			ka = uva2ka(p->lpgdir, (char*)p->laddr);
+			m = min(n - i, p->lleft);
+			m = min(m, PGSIZE - p->laddr % PGSIZE);
+			memmove(addr + i, ka + p->laddr % PGSIZE, m);
+			p->laddr += m;
+			p->lleft -= m;
+		}
+		if(p->lleft == 0){
+			wakeup(&p->nwrite);
+			pollwakeup(&p->wpoll);
+		}
 	}
-	wakeup(&p->nwrite);  //DOC: piperead-wakeup
 	release(&p->lock);
 	return i;
 }
+
+// Return the POLL* flags that hold for the read end of p, or the
+// write end if writable, and queue e to be woken when they change.
+int
+pipepoll(struct pipe *p, int writable, struct pollent *e)
+{
+	int r;
+
+	r = 0;
+	acquire(&p->lock);
+	if(e)
+		pollqueue(writable ? &p->wpoll : &p->rpoll, e);
+	if(writable){
+		if(p->readopen == 0)
+			r = POLLERR;
+		else if(p->nwrite != p->nread + PIPESIZE(p) && p->lleft == 0)
+			r = POLLOUT;
+	} else {
+		if(p->nread != p->nwrite || p->lleft > 0)
+			r = POLLIN;
+		if(p->writeopen == 0)
+			r |= POLLHUP;
+	}
+	release(&p->lock);
+	return r;
+}
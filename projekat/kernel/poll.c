@@ -0,0 +1,102 @@
+// Poll: let one process wait for any of several files.
+//
+// A pipe end or tty that poll() may wait on keeps a queue of
+// pollents, one per poll() call waiting on it, and calls
+// pollwakeup() on that queue when it becomes readable or
+// writable.  Only the pollers queued there are woken, so a
+// process waiting on many files is woken only by those files.
+// A poll() with a timeout also queues itself on the clock.
+//
+// poll() queues its pollents before it checks whether anything
+// is ready, and pollwakeup() sets w->woken under polllock, which
+// pollsleep() holds from its check until it sleeps, so a change
+// that happens after the check is never missed.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+
+static struct spinlock polllock;
+static struct pollent *clockq;  // pollers with a timeout
+
+void
+pollinit(void)
+{
+	initlock(&polllock, "poll");
+}
+
+// Put e on queue q.  e->w must be set.
+void
+pollqueue(struct pollent **q, struct pollent *e)
+{
+	acquire(&polllock);
+	e->q = q;
+	e->next = *q;
+	*q = e;
+	release(&polllock);
+}
+
+// Take e off the queue it is on, if any.
+void
+polldequeue(struct pollent *e)
+{
+	struct pollent **pp;
+
+	acquire(&polllock);
+	if(e->q){
+		for(pp = e->q; *pp; pp = &(*pp)->next)
+			if(*pp == e){
+				*pp = e->next;
+				break;
+			}
+		e->q = 0;
+	}
+	release(&polllock);
+}
+
+// Wake the pollers on queue q.
+void
+pollwakeup(struct pollent **q)
+{
+	struct pollent *e;
+
+	acquire(&polllock);
+	for(e = *q; e; e = e->next){
+		e->w->woken = 1;
+		wakeup(e->w);
+	}
+	release(&polllock);
+}
+
+// Wake the pollers on queue q once per tick, so they can
+// check their timeouts.
+void
+pollclock(struct pollent *e)
+{
+	pollqueue(&clockq, e);
+}
+
+// Called by the timer interrupt.
+void
+polltick(void)
+{
+	if(clockq)
+		pollwakeup(&clockq);
+}
+
+// Sleep until one of the pollents using w is woken.
+void
+pollsleep(struct pollwait *w)
+{
+	acquire(&polllock);
+	while(!w->woken && !myproc()->killed)
+		sleep(w, &polllock);
+	w->woken = 0;
+	release(&polllock);
+}
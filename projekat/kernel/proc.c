@@ -5,13 +5,22 @@
 #include "mmu.h"
 #include "x86.h"
 #include "proc.h"
+#include "traps.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 
 struct {
 	struct spinlock lock;
 	struct proc proc[NPROC];
 } ptable;
 
+// One lock per address space, indexed by the slot of the thread
+// group leader that owns the page table.  It serializes changes
+// to the user mappings against each other and against fork().
+static struct sleeplock vmlocks[NPROC];
+
 static struct proc *initproc;
 
 int nextpid = 1;
@@ -23,7 +32,71 @@ static void wakeup1(void *chan);
 void
 pinit(void)
 {
+	int i;
+
 	initlock(&ptable.lock, "ptable");
+	for(i = 0; i < NPROC; i++)
+		initsleeplock(&vmlocks[i], "vm");
+}
+
+// Lock the current process's address space.
+void
+vmlock(void)
+{
+	acquiresleep(&vmlocks[myproc()->leader - ptable.proc]);
+}
+
+void
+vmunlock(void)
+{
+	releasesleep(&vmlocks[myproc()->leader - ptable.proc]);
+}
+
+// Flush pgdir's entries from the TLBs of every CPU that may hold
+// them, after PTEs have been removed from it and before the pages
+// they mapped are reused.  Other CPUs running a thread on pgdir
+// get a T_TLBFLUSH interrupt, and we wait until they have taken
+// it, so the caller must not hold any spinlocks.
+void
+tlbshootdown(pde_t *pgdir)
+{
+	struct cpu *c;
+	uint want[NCPU];
+	int sent[NCPU];
+	int i;
+
+	acquire(&ptable.lock);
+	for(i = 0; i < ncpu; i++){
+		c = &cpus[i];
+		sent[i] = 0;
+		if(c->proc == 0 || c->proc->pgdir != pgdir)
+			continue;
+		if(c == mycpu()){
+			lcr3(V2P(pgdir));
+			continue;
+		}
+		want[i] = __sync_add_and_fetch(&c->tlbreq, 1);
+		lapicipi(c->apicid, T_TLBFLUSH);
+		sent[i] = 1;
+	}
+	release(&ptable.lock);
+
+	for(i = 0; i < ncpu; i++)
+		if(sent[i])
+			while((int)(cpus[i].tlbdone - want[i]) < 0)
+				;
+}
+
+// Take a T_TLBFLUSH interrupt from tlbshootdown().
+void
+tlbintr(void)
+{
+	struct cpu *c = mycpu();
+	uint n;
+
+	n = c->tlbreq;
+	lcr3(rcr3());
+	c->tlbdone = n;
 }
 
 // Must be called with interrupts disabled
@@ -89,6 +162,8 @@ allocproc(void)
 found:
 	p->state = EMBRYO;
 	p->pid = nextpid++;
+	p->leader = p;
+	p->ustack = 0;
 
 	release(&ptable.lock);
 
@@ -140,7 +215,9 @@ userinit(void)
 	p->tf->eip = 0;  // beginning of initcode.S
 
 	safestrcpy(p->name, "initcode", sizeof(p->name));
-	p->cwd = namei("/");
+	if((p->files = filesalloc()) == 0)
+		panic("userinit: no file table");
+	p->files->cwd = namei("/");
 
 	// this assignment to p->state lets other cores
 	// run this process. the acquire forces the above
@@ -154,24 +231,43 @@ userinit(void)
 }
 
 // Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Return the old size on success, -1 on failure.
+// Threads share the memory, so all of them see the new size.
+// Pages given back are unmapped and flushed from the TLBs of the
+// CPUs running other threads before they are freed.
 int
 growproc(int n)
 {
-	uint sz;
+	uint sz, oldsz;
+	struct proc *p;
 	struct proc *curproc = myproc();
 
-	sz = curproc->sz;
+	vmlock();
+	sz = oldsz = curproc->sz;
 	if(n > 0){
-		if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+		if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0){
+			vmunlock();
 			return -1;
+		}
 	} else if(n < 0){
-		if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+		if(sz + n > sz){
+			vmunlock();
 			return -1;
+		}
+		sz += n;
 	}
-	curproc->sz = sz;
-	switchuvm(curproc);
-	return 0;
+	acquire(&ptable.lock);
+	for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+		if(p->state != UNUSED && p->pgdir == curproc->pgdir)
+			p->sz = sz;
+	release(&ptable.lock);
+	if(sz < oldsz){
+		unmapuvm(curproc->pgdir, oldsz, sz);
+		tlbshootdown(curproc->pgdir);
+		deallocuvm(curproc->pgdir, oldsz, sz);
+	}
+	vmunlock();
+	return oldsz;
 }
 
 // Create a new process copying p as the parent.
@@ -180,7 +276,7 @@ growproc(int n)
 int
 fork(void)
 {
-	int i, pid;
+	int pid;
 	struct proc *np;
 	struct proc *curproc = myproc();
 
@@ -190,23 +286,79 @@ fork(void)
 	}
 
 	// Copy process state from proc.
+	vmlock();
 	if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+		vmunlock();
 		kfree(np->kstack);
 		np->kstack = 0;
 		np->state = UNUSED;
 		return -1;
 	}
 	np->sz = curproc->sz;
+	if(shmfork(np, curproc->leader) < 0 || mmapfork(np, curproc->leader) < 0 ||
+	   (np->files = filescopy(curproc->files)) == 0){
+		vmunlock();
+		mmapcloseall(np);
+		shmcloseall(np);
+		freevm(np->pgdir);
+		kfree(np->kstack);
+		np->kstack = 0;
+		np->state = UNUSED;
+		return -1;
+	}
+	vmunlock();
 	np->parent = curproc;
 	*np->tf = *curproc->tf;
 
 	// Clear %eax so that fork returns 0 in the child.
 	np->tf->eax = 0;
 
-	for(i = 0; i < NOFILE; i++)
-		if(curproc->ofile[i])
-			np->ofile[i] = filedup(curproc->ofile[i]);
-	np->cwd = idup(curproc->cwd);
+	safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+	pid = np->pid;
+
+	acquire(&ptable.lock);
+
+	np->state = RUNNABLE;
+
+	release(&ptable.lock);
+
+	return pid;
+}
+
+// Create a new thread that shares the current process's
+// memory, open files and current directory, running fn(arg)
+// on the user stack whose top is at stack.
+// Returns the new thread's pid, or -1.
+int
+clone(uint fn, uint stack, uint arg)
+{
+	int pid;
+	uint ustack[2];
+	struct proc *np;
+	struct proc *curproc = myproc();
+
+	if(stack % 4 != 0 || stack < sizeof(ustack) || stack > curproc->sz)
+		return -1;
+
+	// Push arg and a fake return PC for fn.
+	ustack[0] = 0xffffffff;
+	ustack[1] = arg;
+	if(copyout(curproc->pgdir, stack - sizeof(ustack), ustack, sizeof(ustack)) < 0)
+		return -1;
+
+	if((np = allocproc()) == 0)
+		return -1;
+
+	np->pgdir = curproc->pgdir;
+	np->sz = curproc->sz;
+	np->leader = curproc->leader;
+	np->parent = curproc->leader;
+	np->ustack = stack;
+	*np->tf = *curproc->tf;
+	np->tf->eip = fn;
+	np->tf->esp = stack - sizeof(ustack);
+	np->files = filesdup(curproc->files);
 
 	safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
@@ -221,31 +373,139 @@ fork(void)
 	return pid;
 }
 
+// Free a zombie thread.  Unlike a process, it leaves
+// its pgdir to the rest of the thread group.
+// Caller must hold ptable.lock.
+static void
+freethread(struct proc *p)
+{
+	kfree(p->kstack);
+	p->kstack = 0;
+	p->pgdir = 0;
+	p->pid = 0;
+	p->parent = 0;
+	p->leader = 0;
+	p->name[0] = 0;
+	p->killed = 0;
+	p->state = UNUSED;
+}
+
+// Does any other thread share p's memory?
+int
+vmshared(struct proc *p)
+{
+	struct proc *q;
+	int shared;
+
+	shared = 0;
+	acquire(&ptable.lock);
+	for(q = ptable.proc; q < &ptable.proc[NPROC]; q++)
+		if(q != p && q->state != UNUSED && q->pgdir == p->pgdir){
+			shared = 1;
+			break;
+		}
+	release(&ptable.lock);
+	return shared;
+}
+
+// Wait for a thread of the current thread group to exit.
+// Return its pid and store its stack in *stack.
+// Return -1 if the group has no other threads.
+int
+join(uint *stack)
+{
+	struct proc *p;
+	int havethreads, pid;
+	struct proc *curproc = myproc();
+
+	acquire(&ptable.lock);
+	for(;;){
+		havethreads = 0;
+		for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+			if(p->leader != curproc->leader || p == p->leader || p == curproc)
+				continue;
+			if(p->state == UNUSED)
+				continue;
+			havethreads = 1;
+			if(p->state == ZOMBIE){
+				pid = p->pid;
+				*stack = p->ustack;
+				freethread(p);
+				release(&ptable.lock);
+				return pid;
+			}
+		}
+
+		if(!havethreads || curproc->killed){
+			release(&ptable.lock);
+			return -1;
+		}
+
+		// Exiting threads wake up their leader.
+		sleep(curproc->leader, &ptable.lock);
+	}
+}
+
+// Kill every other thread of the current process, which
+// must be the thread group leader, and wait for them to exit.
+// Used before the address space goes away in exec() and exit().
+void
+killthreads(void)
+{
+	struct proc *p;
+	int havethreads;
+	struct proc *curproc = myproc();
+
+	if(curproc->leader != curproc)
+		panic("killthreads");
+
+	acquire(&ptable.lock);
+	for(;;){
+		havethreads = 0;
+		for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+			if(p->leader != curproc || p == curproc || p->state == UNUSED)
+				continue;
+			if(p->state == ZOMBIE){
+				freethread(p);
+				continue;
+			}
+			havethreads = 1;
+			p->killed = 1;
+			if(p->state == SLEEPING)
+				p->state = RUNNABLE;
+		}
+		if(!havethreads)
+			break;
+		sleep(curproc, &ptable.lock);
+	}
+	release(&ptable.lock);
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
+// A thread exits alone and is reaped by join(); when the
+// thread group leader exits, it takes its threads along.
 void
 exit(void)
 {
 	struct proc *curproc = myproc();
 	struct proc *p;
-	int fd;
 
 	if(curproc == initproc)
 		panic("init exiting");
 
-	// Close all open files.
-	for(fd = 0; fd < NOFILE; fd++){
-		if(curproc->ofile[fd]){
-			fileclose(curproc->ofile[fd]);
-			curproc->ofile[fd] = 0;
-		}
-	}
+	if(curproc->leader == curproc)
+		killthreads();
+
+	// Close all open files, if no other thread uses them.
+	filesput(curproc->files);
+	curproc->files = 0;
 
-	begin_op();
-	iput(curproc->cwd);
-	end_op();
-	curproc->cwd = 0;
+	// Unmap files and shared memory, so that freevm() in
+	// wait() leaves the shared pages alone.
+	mmapcloseall(curproc);
+	shmcloseall(curproc);
 
 	acquire(&ptable.lock);
 
@@ -281,7 +541,7 @@ wait(void)
 		// Scan through table looking for exited children.
 		havekids = 0;
 		for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-			if(p->parent != curproc)
+			if(p->parent != curproc || p->leader != p)
 				continue;
 			havekids = 1;
 			if(p->state == ZOMBIE){
@@ -290,8 +550,10 @@ wait(void)
 				kfree(p->kstack);
 				p->kstack = 0;
 				freevm(p->pgdir);
+				p->pgdir = 0;
 				p->pid = 0;
 				p->parent = 0;
+				p->leader = 0;
 				p->name[0] = 0;
 				p->killed = 0;
 				p->state = UNUSED;
@@ -480,6 +742,25 @@ wakeup(void *chan)
 	release(&ptable.lock);
 }
 
+// Wake up at most n processes sleeping on chan.
+// Returns the number of processes woken.
+int
+wakeupn(void *chan, int n)
+{
+	struct proc *p;
+	int woken;
+
+	woken = 0;
+	acquire(&ptable.lock);
+	for(p = ptable.proc; p < &ptable.proc[NPROC] && woken < n; p++)
+		if(p->state == SLEEPING && p->chan == chan){
+			p->state = RUNNABLE;
+			woken++;
+		}
+	release(&ptable.lock);
+	return woken;
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
@@ -8,6 +8,8 @@ struct cpu {
 	int ncli;                    // Depth of pushcli nesting.
 	int intena;                  // Were interrupts enabled before pushcli?
 	struct proc *proc;           // The process running on this cpu or null
+	volatile uint tlbreq;        // TLB flushes asked of this cpu
+	volatile uint tlbdone;       // TLB flushes it has done
 };
 
 extern struct cpu cpus[NCPU];
@@ -31,8 +33,25 @@ struct context {
 	uint eip;
 };
 
+// Per-process shared memory descriptor (see shm.c)
+struct shmdesc {
+	struct shm *shm;             // Shared object, or 0 if slot is free
+	uint va;                     // Mapped address, or 0 if not mapped
+	int perm;                    // PTE permissions of the mapping
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// Memory-mapped file region, see mmap.c.
+struct vma {
+	uint start;                  // First address, 0 if unused
+	uint end;                    // One past the last address
+	struct file *f;              // Mapped file
+	uint off;                    // File offset of start
+	int prot;                    // PROT_READ, PROT_WRITE
+	int flags;                   // MAP_SHARED or MAP_PRIVATE
+};
+
 // Per-process state
 struct proc {
 	uint sz;                     // Size of process memory (bytes)
@@ -41,12 +60,15 @@ struct proc {
 	enum procstate state;        // Process state
 	int pid;                     // Process ID
 	struct proc *parent;         // Parent process
+	struct proc *leader;         // Owner of pgdir; self unless a thread
+	uint ustack;                 // Thread's initial stack pointer (clone)
 	struct trapframe *tf;        // Trap frame for current syscall
 	struct context *context;     // swtch() here to run process
 	void *chan;                  // If non-zero, sleeping on chan
 	int killed;                  // If non-zero, have been killed
-	struct file *ofile[NOFILE];  // Open files
-	struct inode *cwd;           // Current directory
+	struct files *files;         // Open files and current directory
+	struct shmdesc shm[NOSHM];   // Open shared memory objects
+	struct vma vma[NVMA];        // Memory-mapped files
 	char name[16];               // Process name (debugging)
 };
 
@@ -0,0 +1,279 @@
+// Named shared memory objects.
+//
+// A process opens an object by name with shm_open(), gives it a
+// size with shm_trunc() and maps it with shm_map().  Every process
+// that maps the same object sees the same physical pages, so data
+// moves between processes (on any terminal) without being copied.
+//
+// Each open object occupies one of the NOSHM per-process
+// descriptors in p->shm[] of the thread group leader, so all
+// threads of a process share them.  Descriptor fd is always
+// mapped in the same window, SHMBASE + fd*SHMWINDOW, which lies
+// above anything growproc() can hand out.  Descriptors are
+// inherited by fork(), and dropped by shm_close(), exec() and
+// exit().
+//
+// An object's ref counts the descriptors referring to it.  The
+// object and its contents stay around after the last descriptor
+// is closed, so a later shm_open() of the same name sees the same
+// data; an unreferenced object is only reclaimed when its table
+// slot is needed for a new name.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "fcntl.h"
+
+#define SHMWINDOW ((KERNBASE - SHMBASE) / NOSHM)
+
+struct shm {
+	char name[SHMNAME];     // Object name, empty if slot is free
+	int ref;                // Number of descriptors referring to it
+	uint size;              // Size in bytes, 0 until shm_trunc()
+	int npages;             // Number of pages in pages[]
+	char *pages[SHMMAXPG];  // Kernel addresses of the object's pages
+};
+
+struct {
+	struct spinlock lock;
+	struct shm shm[NSHM];
+} shmtable;
+
+void
+shminit(void)
+{
+	if(SHMMAXPG*PGSIZE > SHMWINDOW)
+		panic("shminit: SHMMAXPG too big");
+	initlock(&shmtable.lock, "shm");
+}
+
+// Free the pages of an unreferenced object and
+// mark its slot free.  Caller must hold shmtable.lock.
+static void
+shmfree(struct shm *s)
+{
+	int i;
+
+	for(i = 0; i < s->npages; i++)
+		kfree(s->pages[i]);
+	s->npages = 0;
+	s->size = 0;
+	s->name[0] = 0;
+}
+
+// Fetch the shared memory descriptor fd of the current process.
+static struct shmdesc*
+shmdesc(int fd)
+{
+	struct shmdesc *d;
+
+	if(fd < 0 || fd >= NOSHM)
+		return 0;
+	d = &myproc()->leader->shm[fd];
+	if(d->shm == 0)
+		return 0;
+	return d;
+}
+
+// Remove descriptor fd of p, unmapping the object if it is mapped.
+// The mapping is flushed from every CPU's TLB before the reference
+// that keeps the pages from being reclaimed is dropped.
+static void
+shmdetach(struct proc *p, int fd)
+{
+	struct shmdesc *d = &p->shm[fd];
+
+	if(d->va){
+		unmapshared(p->pgdir, d->va, d->shm->npages);
+		tlbshootdown(p->pgdir);
+	}
+
+	acquire(&shmtable.lock);
+	d->shm->ref--;
+	release(&shmtable.lock);
+
+	d->shm = 0;
+	d->va = 0;
+	d->perm = 0;
+}
+
+// Open the object called name, creating it if it does not exist.
+// Returns a shared memory descriptor, or -1.
+int
+shmopen(char *name)
+{
+	struct shm *s, *found, *empty, *unused;
+	struct proc *curproc = myproc()->leader;
+	int fd;
+
+	if(*name == 0 || strlen(name) >= SHMNAME)
+		return -1;
+	for(fd = 0; fd < NOSHM; fd++)
+		if(curproc->shm[fd].shm == 0)
+			break;
+	if(fd == NOSHM)
+		return -1;
+
+	acquire(&shmtable.lock);
+	found = empty = unused = 0;
+	for(s = shmtable.shm; s < &shmtable.shm[NSHM]; s++){
+		if(s->name[0] == 0){
+			if(empty == 0)
+				empty = s;
+		} else if(strncmp(s->name, name, SHMNAME) == 0){
+			found = s;
+			break;
+		} else if(s->ref == 0 && unused == 0)
+			unused = s;
+	}
+
+	if(found == 0){
+		// Prefer a free slot; otherwise recycle an object
+		// that no process has open.
+		if((found = empty) == 0 && (found = unused) != 0)
+			shmfree(found);
+		if(found == 0){
+			release(&shmtable.lock);
+			return -1;
+		}
+		safestrcpy(found->name, name, SHMNAME);
+	}
+	found->ref++;
+	release(&shmtable.lock);
+
+	curproc->shm[fd].shm = found;
+	curproc->shm[fd].va = 0;
+	curproc->shm[fd].perm = 0;
+	return fd;
+}
+
+// Give the object behind fd a size of sz bytes, rounded up
+// to whole pages.  The size of an object is fixed by the first
+// shm_trunc(); later calls just return it.
+// Returns the object size, or -1.
+int
+shmtrunc(int fd, int sz)
+{
+	struct shmdesc *d;
+	struct shm *s;
+	int i, n;
+
+	if((d = shmdesc(fd)) == 0)
+		return -1;
+	s = d->shm;
+
+	acquire(&shmtable.lock);
+	if(s->size == 0){
+		if(sz <= 0 || sz > SHMMAXPG*PGSIZE){
+			release(&shmtable.lock);
+			return -1;
+		}
+		n = PGROUNDUP(sz) / PGSIZE;
+		for(i = 0; i < n; i++){
+			if((s->pages[i] = kalloc()) == 0){
+				while(--i >= 0)
+					kfree(s->pages[i]);
+				release(&shmtable.lock);
+				return -1;
+			}
+			memset(s->pages[i], 0, PGSIZE);
+		}
+		s->npages = n;
+		s->size = n * PGSIZE;
+	}
+	sz = s->size;
+	release(&shmtable.lock);
+	return sz;
+}
+
+// Map the object behind fd into the current process, read-only
+// if mode is O_RDONLY and read-write otherwise.
+// Returns the address of the mapping, or 0.
+int
+shmmap(int fd, int mode)
+{
+	struct shmdesc *d;
+	struct proc *curproc = myproc()->leader;
+	uint va;
+	int perm;
+
+	vmlock();
+	if((d = shmdesc(fd)) == 0 || d->va != 0 || d->shm->size == 0){
+		vmunlock();
+		return 0;
+	}
+
+	va = SHMBASE + fd*SHMWINDOW;
+	perm = PTE_U;
+	if(mode != O_RDONLY)
+		perm |= PTE_W;
+	if(mapshared(curproc->pgdir, va, d->shm->pages, d->shm->npages, perm) < 0){
+		vmunlock();
+		return 0;
+	}
+	d->va = va;
+	d->perm = perm;
+	vmunlock();
+	return va;
+}
+
+// Close descriptor fd, unmapping the object if it is mapped.
+int
+shmclose(int fd)
+{
+	vmlock();
+	if(shmdesc(fd) == 0){
+		vmunlock();
+		return -1;
+	}
+	shmdetach(myproc()->leader, fd);
+	vmunlock();
+	return 0;
+}
+
+// Give child np a copy of p's descriptors, with the same mappings.
+// Returns 0 on success, -1 on failure (np keeps what it got so
+// far; the caller should shmcloseall(np)).
+int
+shmfork(struct proc *np, struct proc *p)
+{
+	struct shmdesc *d;
+	int fd;
+
+	for(fd = 0; fd < NOSHM; fd++){
+		d = &p->shm[fd];
+		if(d->shm == 0)
+			continue;
+
+		acquire(&shmtable.lock);
+		d->shm->ref++;
+		release(&shmtable.lock);
+
+		np->shm[fd].shm = d->shm;
+		np->shm[fd].va = 0;
+		np->shm[fd].perm = d->perm;
+		if(d->va == 0)
+			continue;
+		if(mapshared(np->pgdir, d->va, d->shm->pages, d->shm->npages, d->perm) < 0)
+			return -1;
+		np->shm[fd].va = d->va;
+	}
+	return 0;
+}
+
+// Close every descriptor of p.  Called from exec() and exit(),
+// and when a process dies from a fault, so that its pgdir can
+// be freed without freeing the shared pages.
+void
+shmcloseall(struct proc *p)
+{
+	int fd;
+
+	for(fd = 0; fd < NOSHM; fd++)
+		if(p->shm[fd].shm)
+			shmdetach(p, fd);
+}
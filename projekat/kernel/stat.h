@@ -9,3 +9,33 @@ struct stat {
 	short nlink; // Number of links to file
 	uint size;   // Size of file in bytes
 };
+
+// Block cache statistics, see bcachestat().
+struct bcstat {
+	uint nbuf;      // Buffers in the cache
+	uint maxbuf;    // Limit on nbuf
+	uint hits;      // Lookups that found the block cached
+	uint misses;    // Lookups that had to recycle a buffer
+	uint evictions; // Misses that threw out a cached block
+};
+
+// Inode cache statistics, see icachestat().
+struct icstat {
+	uint ninode;    // Inodes in the cache
+	uint nref;      // Inodes in use
+	uint hits;      // Lookups that found the inode cached
+	uint misses;    // Lookups that had to recycle an inode
+};
+
+// Disk request order, see idestat().
+#define DISK_FIFO  0
+#define DISK_CLOOK 1
+
+// Disk statistics, see idestat().
+struct diskstat {
+	uint sched;     // DISK_FIFO or DISK_CLOOK
+	uint cmds;      // Commands issued to the disk
+	uint sectors;   // Sectors transferred
+	uint seek;      // Total distance in sectors between commands
+	uint expired;   // Requests moved ahead for their deadline
+};
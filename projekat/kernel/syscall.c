@@ -13,13 +13,37 @@
 // library system call function. The saved user %esp points
 // to a saved program counter, and then the first argument.
 
+// Check that the n bytes at addr, which lie above p->sz, are in
+// mapped files or shared memory of the current process that the
+// kernel may read, and write too if write is set.  Pages of mapped
+// files that haven't been touched yet are faulted in.
+static int
+mapvalid(uint addr, uint n, int write)
+{
+	pde_t *pgdir = myproc()->pgdir;
+	pte_t *pte;
+	uint va;
+
+	if(addr < MMAPBASE || addr+n < addr || addr+n > KERNBASE)
+		return -1;
+	for(va = PGROUNDDOWN(addr); va < addr+n; va += PGSIZE){
+		if(va < SHMBASE && mmapfault(va, write ? FEC_WR : 0) < 0)
+			return -1;
+		pte = walkpgdir(pgdir, (char*)va, 0);
+		if(pte == 0 || (*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U) ||
+		   (write && (*pte & PTE_W) == 0))
+			return -1;
+	}
+	return 0;
+}
+
 // Fetch the int at addr from the current process.
 int
 fetchint(uint addr, int *ip)
 {
 	struct proc *curproc = myproc();
 
-	if(addr >= curproc->sz || addr+4 > curproc->sz)
+	if((addr >= curproc->sz || addr+4 > curproc->sz) && mapvalid(addr, 4, 0) < 0)
 		return -1;
 	*ip = *(int*)(addr);
 	return 0;
@@ -31,18 +55,18 @@ fetchint(uint addr, int *ip)
 int
 fetchstr(uint addr, char **pp)
 {
-	char *s, *ep;
+	char *s;
 	struct proc *curproc = myproc();
 
-	if(addr >= curproc->sz)
-		return -1;
 	*pp = (char*)addr;
-	ep = (char*)curproc->sz;
-	for(s = *pp; s < ep; s++){
+	for(s = *pp; ; s++){
+		// Check each page above p->sz as the string enters it.
+		if((uint)s == addr || (uint)s == curproc->sz || (uint)s % PGSIZE == 0)
+			if((uint)s >= curproc->sz && mapvalid((uint)s, 1, 0) < 0)
+				return -1;
 		if(*s == 0)
 			return s - *pp;
 	}
-	return -1;
 }
 
 // Fetch the nth 32-bit system call argument.
@@ -53,8 +77,8 @@ argint(int n, int *ip)
 }
 
 // Fetch the nth word-sized system call argument as a pointer
-// to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
+// to a block of memory of size bytes that the kernel may write.
+// Check that the pointer lies within the process address space.
 int
 argptr(int n, char **pp, int size)
 {
@@ -63,7 +87,29 @@ argptr(int n, char **pp, int size)
 
 	if(argint(n, &i) < 0)
 		return -1;
-	if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+	if(size < 0)
+		return -1;
+	if(((uint)i >= curproc->sz || (uint)i+size > curproc->sz) &&
+	   mapvalid(i, size, 1) < 0)
+		return -1;
+	*pp = (char*)i;
+	return 0;
+}
+
+// Like argptr, but the block need only be readable, so that
+// read-only mappings can be passed to write().
+int
+argrdptr(int n, char **pp, int size)
+{
+	int i;
+	struct proc *curproc = myproc();
+
+	if(argint(n, &i) < 0)
+		return -1;
+	if(size < 0)
+		return -1;
+	if(((uint)i >= curproc->sz || (uint)i+size > curproc->sz) &&
+	   mapvalid(i, size, 0) < 0)
 		return -1;
 	*pp = (char*)i;
 	return 0;
@@ -71,8 +117,8 @@ argptr(int n, char **pp, int size)
 
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// (A string in shared memory can change after this check, so
+// callers must not trust its length beyond the nul found here.)
 int
 argstr(int n, char **pp)
 {
@@ -109,6 +155,27 @@ extern int sys_setfg(void);
 extern int sys_setbg(void);
 extern int sys_sethex(void);
 
+extern int sys_shm_open(void);
+extern int sys_shm_trunc(void);
+extern int sys_shm_map(void);
+extern int sys_shm_close(void);
+
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_bcachestat(void);
+extern int sys_diskstat(void);
+extern int sys_fsync(void);
+extern int sys_icachestat(void);
+extern int sys_pipesize(void);
+extern int sys_splice(void);
+extern int sys_sendfile(void);
+extern int sys_poll(void);
+
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
 [SYS_exit]    sys_exit,
@@ -135,6 +202,24 @@ static int (*syscalls[])(void) = {
 [SYS_setfg]   sys_setfg,
 [SYS_setbg]   sys_setbg,
 [SYS_sethex]  sys_sethex,
+[SYS_shm_open]  sys_shm_open,
+[SYS_shm_trunc] sys_shm_trunc,
+[SYS_shm_map]   sys_shm_map,
+[SYS_shm_close] sys_shm_close,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_bcachestat] sys_bcachestat,
+[SYS_diskstat] sys_diskstat,
+[SYS_fsync]   sys_fsync,
+[SYS_icachestat] sys_icachestat,
+[SYS_pipesize] sys_pipesize,
+[SYS_splice]  sys_splice,
+[SYS_sendfile] sys_sendfile,
+[SYS_poll]    sys_poll,
 };
 
 void
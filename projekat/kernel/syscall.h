@@ -23,4 +23,22 @@
 #define SYS_rstclr 22
 #define SYS_setfg  23
 #define SYS_setbg  24
-#define SYS_sethex 25
\ No newline at end of file
+#define SYS_sethex 25
+#define SYS_shm_open  26
+#define SYS_shm_trunc 27
+#define SYS_shm_map   28
+#define SYS_shm_close 29
+#define SYS_futex_wait 30
+#define SYS_futex_wake 31
+#define SYS_clone  32
+#define SYS_join   33
+#define SYS_mmap   34
+#define SYS_munmap 35
+#define SYS_bcachestat 36
+#define SYS_diskstat 37
+#define SYS_fsync 38
+#define SYS_icachestat 39
+#define SYS_pipesize 40
+#define SYS_splice 41
+#define SYS_sendfile 42
+#define SYS_poll 43
\ No newline at end of file
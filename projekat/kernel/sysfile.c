@@ -16,53 +16,32 @@
 #include "file.h"
 #include "fcntl.h"
 
-// Fetch the nth word-sized system call argument as a file descriptor
-// and return both the descriptor and the corresponding struct file.
+// Fetch the nth word-sized system call argument as a file
+// descriptor and return the corresponding struct file, with a
+// reference the caller must drop with fileclose().  Threads
+// share the descriptors, so another one may close fd meanwhile.
 static int
-argfd(int n, int *pfd, struct file **pf)
+argfd(int n, struct file **pf)
 {
 	int fd;
-	struct file *f;
 
 	if(argint(n, &fd) < 0)
 		return -1;
-	if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+	if((*pf = fdget(fd)) == 0)
 		return -1;
-	if(pfd)
-		*pfd = fd;
-	if(pf)
-		*pf = f;
 	return 0;
 }
 
-// Allocate a file descriptor for the given file.
-// Takes over file reference from caller on success.
-static int
-fdalloc(struct file *f)
-{
-	int fd;
-	struct proc *curproc = myproc();
-
-	for(fd = 0; fd < NOFILE; fd++){
-		if(curproc->ofile[fd] == 0){
-			curproc->ofile[fd] = f;
-			return fd;
-		}
-	}
-	return -1;
-}
-
 int
 sys_dup(void)
 {
 	struct file *f;
 	int fd;
 
-	if(argfd(0, 0, &f) < 0)
+	if(argfd(0, &f) < 0)
 		return -1;
 	if((fd=fdalloc(f)) < 0)
-		return -1;
-	filedup(f);
+		fileclose(f);
 	return fd;
 }
 
@@ -70,24 +49,28 @@ int
 sys_read(void)
 {
 	struct file *f;
-	int n;
+	int n, r;
 	char *p;
 
-	if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+	if(argint(2, &n) < 0 || argptr(1, &p, n) < 0 || argfd(0, &f) < 0)
 		return -1;
-	return fileread(f, p, n);
+	r = fileread(f, p, n);
+	fileclose(f);
+	return r;
 }
 
 int
 sys_write(void)
 {
 	struct file *f;
-	int n;
+	int n, r;
 	char *p;
 
-	if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+	if(argint(2, &n) < 0 || argrdptr(1, &p, n) < 0 || argfd(0, &f) < 0)
 		return -1;
-	return filewrite(f, p, n);
+	r = filewrite(f, p, n);
+	fileclose(f);
+	return r;
 }
 
 int
@@ -96,9 +79,8 @@ sys_close(void)
 	int fd;
 	struct file *f;
 
-	if(argfd(0, &fd, &f) < 0)
+	if(argint(0, &fd) < 0 || (f = fdremove(fd)) == 0)
 		return -1;
-	myproc()->ofile[fd] = 0;
 	fileclose(f);
 	return 0;
 }
@@ -108,10 +90,13 @@ sys_fstat(void)
 {
 	struct file *f;
 	struct stat *st;
+	int r;
 
-	if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+	if(argptr(1, (void*)&st, sizeof(*st)) < 0 || argfd(0, &f) < 0)
 		return -1;
-	return filestat(f, st);
+	r = filestat(f, st);
+	fileclose(f);
+	return r;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -165,16 +150,17 @@ bad:
 }
 
 // Is the directory dp empty except for "." and ".." ?
+// In a hashed directory they can be anywhere.
 static int
 isdirempty(struct inode *dp)
 {
 	int off;
 	struct dirent de;
 
-	for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
+	for(off=0; off<dp->size; off+=sizeof(de)){
 		if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
 			panic("isdirempty: readi");
-		if(de.inum != 0)
+		if(de.inum != 0 && namecmp(de.name, ".") != 0 && namecmp(de.name, "..") != 0)
 			return 0;
 	}
 	return 1;
@@ -184,7 +170,6 @@ int
 sys_unlink(void)
 {
 	struct inode *ip, *dp;
-	struct dirent de;
 	char name[DIRSIZ], *path;
 	uint off;
 
@@ -214,9 +199,7 @@ sys_unlink(void)
 		goto bad;
 	}
 
-	memset(&de, 0, sizeof(de));
-	if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-		panic("unlink: writei");
+	dirunlink(dp, name, off);
 	if(ip->type == T_DIR){
 		dp->nlink--;
 		iupdate(dp);
@@ -273,8 +256,18 @@ create(char *path, short type, short major, short minor)
 			panic("create dots");
 	}
 
-	if(dirlink(dp, name, ip->inum) < 0)
-		panic("create: dirlink");
+	if(dirlink(dp, name, ip->inum) < 0){
+		// The directory is full; free ip again.
+		if(type == T_DIR){
+			dp->nlink--;
+			iupdate(dp);
+		}
+		ip->nlink = 0;
+		iupdate(ip);
+		iunlockput(ip);
+		iunlockput(dp);
+		return 0;
+	}
 
 	iunlockput(dp);
 
@@ -326,6 +319,8 @@ sys_open(void)
 	f->type = FD_INODE;
 	f->ip = ip;
 	f->off = 0;
+	f->ranext = 0;
+	f->raend = 0;
 	f->readable = !(omode & O_WRONLY);
 	f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
 	return fd;
@@ -372,7 +367,6 @@ sys_chdir(void)
 {
 	char *path;
 	struct inode *ip;
-	struct proc *curproc = myproc();
 
 	begin_op();
 	if(argstr(0, &path) < 0 || (ip = namei(path)) == 0){
@@ -386,9 +380,8 @@ sys_chdir(void)
 		return -1;
 	}
 	iunlock(ip);
-	iput(curproc->cwd);
+	iput(cwdset(ip));
 	end_op();
-	curproc->cwd = ip;
 	return 0;
 }
 
@@ -432,7 +425,7 @@ sys_pipe(void)
 	fd0 = -1;
 	if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
 		if(fd0 >= 0)
-			myproc()->ofile[fd0] = 0;
+			fdremove(fd0);
 		fileclose(rf);
 		fileclose(wf);
 		return -1;
@@ -442,3 +435,211 @@ sys_pipe(void)
 	return 0;
 }
 
+int
+sys_mmap(void)
+{
+	struct file *f;
+	int off, len, prot, flags, r;
+
+	if(argint(1, &off) < 0 || argint(2, &len) < 0 ||
+	   argint(3, &prot) < 0 || argint(4, &flags) < 0)
+		return -1;
+	if(off < 0 || argfd(0, &f) < 0)
+		return -1;
+	r = mmap(f, off, len, prot, flags);
+	fileclose(f);
+	return r;
+}
+
+int
+sys_munmap(void)
+{
+	int addr, len;
+
+	if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+		return -1;
+	return munmap(addr, len);
+}
+
+int
+sys_bcachestat(void)
+{
+	struct bcstat *st;
+	int max;
+
+	if(argptr(0, (void*)&st, sizeof(*st)) < 0 || argint(1, &max) < 0)
+		return -1;
+	return bcachestat(st, max);
+}
+
+int
+sys_diskstat(void)
+{
+	struct diskstat *st;
+	int sched;
+
+	if(argptr(0, (void*)&st, sizeof(*st)) < 0 || argint(1, &sched) < 0)
+		return -1;
+	idestat(st, sched);
+	return 0;
+}
+
+// Wait until the updates made so far to the file
+// behind fd, and to the rest of the file system,
+// are on disk.
+int
+sys_fsync(void)
+{
+	struct file *f;
+	int r;
+
+	if(argfd(0, &f) < 0)
+		return -1;
+	r = -1;
+	if(f->type == FD_INODE){
+		log_sync();
+		r = 0;
+	}
+	fileclose(f);
+	return r;
+}
+
+int
+sys_icachestat(void)
+{
+	struct icstat *st;
+
+	if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+		return -1;
+	icachestat(st);
+	return 0;
+}
+
+// Set the size of a pipe's buffer to at least n bytes, or
+// just return it if n is 0.
+int
+sys_pipesize(void)
+{
+	struct file *f;
+	int n, r;
+
+	if(argint(1, &n) < 0 || argfd(0, &f) < 0)
+		return -1;
+	r = -1;
+	if(f->type == FD_PIPE)
+		r = piperesize(f->pipe, n);
+	fileclose(f);
+	return r;
+}
+
+// Move up to n bytes from fd fin to fd fout within the kernel.
+int
+sys_splice(void)
+{
+	struct file *fin, *fout;
+	int n, r;
+
+	if(argint(2, &n) < 0 || argfd(0, &fin) < 0)
+		return -1;
+	if(argfd(1, &fout) < 0){
+		fileclose(fin);
+		return -1;
+	}
+	r = filesplice(fin, 0, fout, n);
+	fileclose(fin);
+	fileclose(fout);
+	return r;
+}
+
+// Like splice, but fin is a file read at *off, which is
+// advanced, if off is not 0.
+int
+sys_sendfile(void)
+{
+	struct file *fout, *fin;
+	uint *off;
+	int n, a, r;
+
+	if(argint(2, &a) < 0 || argint(3, &n) < 0)
+		return -1;
+	off = 0;
+	if(a != 0 && argptr(2, (void*)&off, sizeof(*off)) < 0)
+		return -1;
+	if(argfd(0, &fout) < 0)
+		return -1;
+	if(argfd(1, &fin) < 0){
+		fileclose(fout);
+		return -1;
+	}
+	r = filesplice(fin, off, fout, n);
+	fileclose(fin);
+	fileclose(fout);
+	return r;
+}
+
+// Wait until one of the n files in fds is ready for the events
+// it asks for, or for timeout ticks if timeout is not negative.
+// Returns the number of fds with revents set.
+int
+sys_poll(void)
+{
+	struct pollfd *fds;
+	struct file *f[NOFILE];
+	struct pollent e[NOFILE+1];
+	struct pollwait w;
+	int n, timeout, i, fd, nready, first;
+	uint t0;
+
+	if(argint(1, &n) < 0 || argint(2, &timeout) < 0 || n < 0 || n > NOFILE ||
+	   argptr(0, (void*)&fds, n*sizeof(*fds)) < 0)
+		return -1;
+
+	// Hold the files, so that none is freed while its
+	// queue has one of our pollents on it.
+	w.woken = 0;
+	for(i = 0; i <= n; i++){
+		e[i].q = 0;
+		e[i].w = &w;
+	}
+	for(i = 0; i < n; i++){
+		f[i] = 0;
+		if((fd = fds[i].fd) >= 0)
+			f[i] = fdget(fd);
+	}
+	if(timeout > 0)
+		pollclock(&e[n]);
+	acquire(&tickslock);
+	t0 = ticks;
+	release(&tickslock);
+
+	for(first = 1;; first = 0){
+		nready = 0;
+		for(i = 0; i < n; i++){
+			if(fds[i].fd < 0)
+				fds[i].revents = 0;
+			else if(f[i] == 0)
+				fds[i].revents = POLLNVAL;
+			else
+				fds[i].revents = filepoll(f[i], first ? &e[i] : 0) &
+					(fds[i].events | POLLERR | POLLHUP);
+			if(fds[i].revents)
+				nready++;
+		}
+		if(nready > 0 || timeout == 0)
+			break;
+		if(timeout > 0 && ticks - t0 >= timeout)
+			break;
+		if(myproc()->killed){
+			nready = -1;
+			break;
+		}
+		pollsleep(&w);
+	}
+
+	for(i = 0; i <= n; i++)
+		polldequeue(&e[i]);
+	for(i = 0; i < n; i++)
+		if(f[i])
+			fileclose(f[i]);
+	return nready;
+}
@@ -13,6 +13,26 @@ sys_fork(void)
 	return fork();
 }
 
+int
+sys_clone(void)
+{
+	int fn, stack, arg;
+
+	if(argint(0, &fn) < 0 || argint(1, &stack) < 0 || argint(2, &arg) < 0)
+		return -1;
+	return clone(fn, stack, arg);
+}
+
+int
+sys_join(void)
+{
+	uint *stack;
+
+	if(argptr(0, (void*)&stack, sizeof(*stack)) < 0)
+		return -1;
+	return join(stack);
+}
+
 int
 sys_exit(void)
 {
@@ -50,8 +70,7 @@ sys_sbrk(void)
 
 	if(argint(0, &n) < 0)
 		return -1;
-	addr = myproc()->sz;
-	if(growproc(n) < 0)
+	if((addr = growproc(n)) < 0)
 		return -1;
 	return addr;
 }
@@ -77,6 +96,72 @@ sys_sleep(void)
 	return 0;
 }
 
+int
+sys_shm_open(void)
+{
+	char *name;
+
+	if(argstr(0, &name) < 0)
+		return -1;
+	return shmopen(name);
+}
+
+int
+sys_shm_trunc(void)
+{
+	int fd, sz;
+
+	if(argint(0, &fd) < 0 || argint(1, &sz) < 0)
+		return -1;
+	return shmtrunc(fd, sz);
+}
+
+int
+sys_shm_map(void)
+{
+	int fd, mode;
+	uint va;
+	void **pva;
+
+	if(argint(0, &fd) < 0 || argptr(1, (void*)&pva, sizeof(*pva)) < 0 ||
+	   argint(2, &mode) < 0)
+		return -1;
+	if((va = shmmap(fd, mode)) == 0)
+		return -1;
+	*pva = (void*)va;
+	return 0;
+}
+
+int
+sys_shm_close(void)
+{
+	int fd;
+
+	if(argint(0, &fd) < 0)
+		return -1;
+	return shmclose(fd);
+}
+
+int
+sys_futex_wait(void)
+{
+	int uaddr, val;
+
+	if(argint(0, &uaddr) < 0 || argint(1, &val) < 0)
+		return -1;
+	return futexwait(uaddr, val);
+}
+
+int
+sys_futex_wake(void)
+{
+	int uaddr, n;
+
+	if(argint(0, &uaddr) < 0 || argint(1, &n) < 0)
+		return -1;
+	return futexwake(uaddr, n);
+}
+
 // return how many clock tick interrupts have occurred
 // since start.
 int
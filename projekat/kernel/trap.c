@@ -52,6 +52,7 @@ trap(struct trapframe *tf)
 			ticks++;
 			wakeup(&ticks);
 			release(&tickslock);
+			polltick();
 		}
 		lapiceoi();
 		break;
@@ -70,6 +71,10 @@ trap(struct trapframe *tf)
 		uartintr();
 		lapiceoi();
 		break;
+	case T_TLBFLUSH:
+		tlbintr();
+		lapiceoi();
+		break;
 	case T_IRQ0 + 7:
 	case T_IRQ0 + IRQ_SPURIOUS:
 		cprintf("cpu%d: spurious interrupt at %x:%x\n",
@@ -77,7 +82,18 @@ trap(struct trapframe *tf)
 		lapiceoi();
 		break;
 
+	case T_PGFLT:
+		if(myproc() && (tf->cs&3) == DPL_USER && mmapfault(rcr2(), tf->err) == 0)
+			break;
+		// fall through
+
 	default:
+		if(tf->trapno == T_IRQ0 + ideirq){
+			// A PCI disk on whatever line the BIOS gave it.
+			ideintr();
+			lapiceoi();
+			break;
+		}
 		if(myproc() == 0 || (tf->cs&3) == 0){
 			// In kernel, it must be our mistake.
 			cprintf("unexpected trap %d from cpu %d eip %x (cr2=0x%x)\n",
@@ -24,6 +24,7 @@
 
 // These are arbitrarily chosen, but with care not to overlap
 // processor defined exceptions or interrupt vectors.
+#define T_TLBFLUSH      60      // TLB shootdown (see tlbshootdown)
 #define T_SYSCALL       64      // system call
 #define T_DEFAULT      500      // catchall
 
@@ -0,0 +1,348 @@
+// Driver for a legacy (virtio 0.9.5) PCI virtio-blk disk.
+// Built instead of ide.c with "make VIRTIO=1", which also has
+// QEMU attach fs.img as a virtio disk; the boot disk stays on
+// IDE, where only the boot loader reads it.  The interface is
+// that of ide.c, and disk 1 is the virtio disk.
+//
+// Each buf becomes one request of three descriptors: the request
+// header, the buf's data and a status byte.  A request goes to
+// the device as soon as there are free descriptors for it, so
+// the device works on up to num/3 of them at once and picks its
+// own order; the rest wait in virtqueue in FIFO order.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "traps.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "stat.h"
+#include "pci.h"
+
+#define SECTOR_SIZE   512
+
+// Legacy virtio PCI registers, from BAR0
+#define VIRTIO_HOST_FEATURES  0x00
+#define VIRTIO_GUEST_FEATURES 0x04
+#define VIRTIO_QUEUE_PFN      0x08
+#define VIRTIO_QUEUE_SIZE     0x0C
+#define VIRTIO_QUEUE_SEL      0x0E
+#define VIRTIO_QUEUE_NOTIFY   0x10
+#define VIRTIO_STATUS         0x12
+#define VIRTIO_ISR            0x13
+#define VIRTIO_BLK_CAPACITY   0x14  // 64 bits, in sectors
+
+// VIRTIO_STATUS bits
+#define VIRTIO_ST_ACK         0x01
+#define VIRTIO_ST_DRIVER      0x02
+#define VIRTIO_ST_DRIVER_OK   0x04
+
+struct vring_desc {
+	uint addr;       // physical address, low 32 bits
+	uint addrhi;
+	uint len;
+	ushort flags;
+	ushort next;
+};
+#define VRING_DESC_F_NEXT  1  // chained with next
+#define VRING_DESC_F_WRITE 2  // device writes (vs reads)
+
+struct vring_avail {
+	ushort flags;
+	ushort idx;
+	ushort ring[];
+};
+
+struct vring_used_elem {
+	uint id;   // head of the completed descriptor chain
+	uint len;
+};
+
+struct vring_used {
+	ushort flags;
+	ushort idx;
+	struct vring_used_elem ring[];
+};
+
+// Request header, the first descriptor of a request.
+struct virtio_blk_req {
+	uint type;
+	uint reserved;
+	uint sector;
+	uint sectorhi;
+};
+#define VIRTIO_BLK_T_IN  0  // read the disk
+#define VIRTIO_BLK_T_OUT 1  // write the disk
+
+#define NUM 256  // largest queue size we handle
+
+// The virtqueue: descriptors and avail ring, then the used
+// ring on the next page boundary.  The device is given its
+// physical address, so it lives in the kernel's bss, which is
+// physically contiguous.
+static char vqpages[3*PGSIZE] __attribute__((aligned(PGSIZE)));
+
+static struct spinlock virtiolock;
+static struct {
+	int iobase;
+	int num;                    // queue size chosen by the device
+	struct vring_desc *desc;
+	struct vring_avail *avail;
+	struct vring_used *used;
+	ushort usedidx;             // next used entry to look at
+	char free[NUM];             // is descriptor free?
+	int nfree;
+	struct {
+		struct buf *b;
+		struct virtio_blk_req hdr;
+		uchar status;
+	} info[NUM];                // by head descriptor
+	uint capacity;              // disk size in sectors
+} disk;
+
+// Bufs waiting for descriptors, linked through qnext.
+static struct buf *virtqueue;
+
+static struct diskstat idestats;
+static uint idelast;  // sector after the last request
+
+// Interrupt line, for trap().
+int ideirq;
+
+void
+ideinit(void)
+{
+	struct pcidev d;
+	uint bar;
+	int i, io;
+
+	initlock(&virtiolock, "virtio");
+
+	// Transitional virtio-blk devices keep the legacy interface.
+	if(pcifind(0x1AF4, 0x1001, -1, -1, &d) < 0)
+		panic("virtio: no disk");
+	bar = pciread(&d, PCI_BAR0);
+	if(!(bar & 1))
+		panic("virtio: no I/O BAR");
+	pciwrite(&d, PCI_CMD, pciread(&d, PCI_CMD) | PCI_CMD_IO | PCI_CMD_MASTER);
+	io = disk.iobase = bar & ~3;
+
+	outb(io + VIRTIO_STATUS, 0);  // reset
+	outb(io + VIRTIO_STATUS, VIRTIO_ST_ACK);
+	outb(io + VIRTIO_STATUS, VIRTIO_ST_ACK|VIRTIO_ST_DRIVER);
+	inl(io + VIRTIO_HOST_FEATURES);
+	outl(io + VIRTIO_GUEST_FEATURES, 0);  // need none
+
+	outw(io + VIRTIO_QUEUE_SEL, 0);
+	disk.num = inw(io + VIRTIO_QUEUE_SIZE);
+	if(disk.num < 3 || disk.num > NUM)
+		panic("virtio: queue size");
+	memset(vqpages, 0, sizeof(vqpages));
+	disk.desc = (struct vring_desc*)vqpages;
+	disk.avail = (struct vring_avail*)(vqpages + disk.num*sizeof(struct vring_desc));
+	disk.used = (struct vring_used*)(vqpages +
+		PGROUNDUP(disk.num*sizeof(struct vring_desc) + (3+disk.num)*sizeof(ushort)));
+	for(i = 0; i < disk.num; i++)
+		disk.free[i] = 1;
+	disk.nfree = disk.num;
+	outl(io + VIRTIO_QUEUE_PFN, V2P(vqpages) / PGSIZE);
+
+	// Sizes past 4G sectors (2TB) are not of interest here.
+	disk.capacity = inl(io + VIRTIO_BLK_CAPACITY);
+	if(inl(io + VIRTIO_BLK_CAPACITY + 4))
+		disk.capacity = 0xFFFFFFFF;
+
+	outb(io + VIRTIO_STATUS, VIRTIO_ST_ACK|VIRTIO_ST_DRIVER|VIRTIO_ST_DRIVER_OK);
+
+	ideirq = d.irq;
+	ioapicenable(ideirq, ncpu - 1);
+}
+
+static int
+allocdesc(void)
+{
+	int i;
+
+	for(i = 0; i < disk.num; i++)
+		if(disk.free[i]){
+			disk.free[i] = 0;
+			disk.nfree--;
+			return i;
+		}
+	panic("virtio: allocdesc");
+}
+
+// Free the descriptor chain starting at i.
+static void
+freechain(int i)
+{
+	for(;;){
+		disk.free[i] = 1;
+		disk.nfree++;
+		if(!(disk.desc[i].flags & VRING_DESC_F_NEXT))
+			break;
+		i = disk.desc[i].next;
+	}
+}
+
+// Hand the request for b to the device.  Returns -1 if
+// there are not enough free descriptors.
+// Caller must hold virtiolock.
+static int
+virtiostart(struct buf *b)
+{
+	int d[3], i;
+	uint sector;
+
+	if(disk.nfree < 3)
+		return -1;
+	for(i = 0; i < 3; i++)
+		d[i] = allocdesc();
+
+	sector = b->blockno * (BSIZE/SECTOR_SIZE);
+	disk.info[d[0]].b = b;
+	disk.info[d[0]].hdr.type = (b->flags & B_DIRTY) ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+	disk.info[d[0]].hdr.reserved = 0;
+	disk.info[d[0]].hdr.sector = sector;
+	disk.info[d[0]].hdr.sectorhi = 0;
+	disk.info[d[0]].status = 0xff;  // device writes 0 on success
+
+	disk.desc[d[0]].addr = V2P(&disk.info[d[0]].hdr);
+	disk.desc[d[0]].len = sizeof(struct virtio_blk_req);
+	disk.desc[d[0]].flags = VRING_DESC_F_NEXT;
+	disk.desc[d[0]].next = d[1];
+
+	disk.desc[d[1]].addr = V2P(b->data);
+	disk.desc[d[1]].len = BSIZE;
+	disk.desc[d[1]].flags = VRING_DESC_F_NEXT;
+	if(!(b->flags & B_DIRTY))
+		disk.desc[d[1]].flags |= VRING_DESC_F_WRITE;
+	disk.desc[d[1]].next = d[2];
+
+	disk.desc[d[2]].addr = V2P(&disk.info[d[0]].status);
+	disk.desc[d[2]].len = 1;
+	disk.desc[d[2]].flags = VRING_DESC_F_WRITE;
+	disk.desc[d[2]].next = 0;
+
+	for(i = 0; i < 3; i++)
+		disk.desc[d[i]].addrhi = 0;
+
+	// Publish the chain before the index that makes
+	// the device look at it.
+	disk.avail->ring[disk.avail->idx % disk.num] = d[0];
+	__sync_synchronize();
+	disk.avail->idx++;
+	__sync_synchronize();
+	outw(disk.iobase + VIRTIO_QUEUE_NOTIFY, 0);
+
+	idestats.cmds++;
+	idestats.sectors += BSIZE/SECTOR_SIZE;
+	idestats.seek += sector > idelast ? sector - idelast : idelast - sector;
+	idelast = sector + BSIZE/SECTOR_SIZE;
+	return 0;
+}
+
+// Interrupt handler.
+void
+ideintr(void)
+{
+	struct buf *b;
+	int id;
+	void (*done)(struct buf*);
+
+	acquire(&virtiolock);
+
+	// Reading the ISR acknowledges the interrupt.
+	inb(disk.iobase + VIRTIO_ISR);
+
+	while(disk.usedidx != *(volatile ushort*)&disk.used->idx){
+		__sync_synchronize();
+		id = disk.used->ring[disk.usedidx % disk.num].id;
+		disk.usedidx++;
+		b = disk.info[id].b;
+		if(b == 0 || disk.info[id].status != 0)
+			panic("virtio: disk error");
+		disk.info[id].b = 0;
+		freechain(id);
+
+		// Wake process waiting for this buf, and tell
+		// whoever submitted it.
+		b->flags |= B_VALID;
+		b->flags &= ~B_DIRTY;
+		wakeup(b);
+		if((done = b->done) != 0){
+			b->done = 0;
+			done(b);
+		}
+	}
+
+	// Start the requests that were waiting for descriptors.
+	while((b = virtqueue) != 0 && virtiostart(b) == 0)
+		virtqueue = b->qnext;
+
+	release(&virtiolock);
+}
+
+// Queue buf for the disk and return without waiting, as
+// in ide.c.  b->done(b) is called with virtiolock held.
+void
+idesubmit(struct buf *b)
+{
+	struct buf **pp;
+
+	if(!holdingsleep(&b->lock))
+		panic("idesubmit: buf not locked");
+	if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
+		panic("idesubmit: nothing to do");
+	if(b->dev != 1)
+		panic("idesubmit: request not for disk 1");
+	if((b->blockno + 1) * (BSIZE/SECTOR_SIZE) > disk.capacity)
+		panic("idesubmit: block out of range");
+
+	acquire(&virtiolock);
+	if(virtqueue != 0 || virtiostart(b) < 0){
+		b->qnext = 0;
+		for(pp = &virtqueue; *pp; pp = &(*pp)->qnext)
+			;
+		*pp = b;
+	}
+	release(&virtiolock);
+}
+
+// Wait for a request submitted without a done callback.
+void
+ideawait(struct buf *b)
+{
+	acquire(&virtiolock);
+	while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
+		sleep(b, &virtiolock);
+	}
+	release(&virtiolock);
+}
+
+// Sync buf with disk.
+void
+iderw(struct buf *b)
+{
+	idesubmit(b);
+	ideawait(b);
+}
+
+// Fill in *st with the disk statistics gathered since the last
+// call, and reset them.  The device orders requests itself, so
+// sched is ignored and the order is reported as DISK_FIFO.
+void
+idestat(struct diskstat *st, int sched)
+{
+	acquire(&virtiolock);
+	idestats.sched = DISK_FIFO;
+	*st = idestats;
+	memset(&idestats, 0, sizeof(idestats));
+	release(&virtiolock);
+}
@@ -32,7 +32,7 @@ seginit(void)
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
 	pde_t *pde;
@@ -224,7 +224,7 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 	char *mem;
 	uint a;
 
-	if(newsz >= KERNBASE)
+	if(newsz > MMAPBASE)
 		return 0;
 	if(newsz < oldsz)
 		return oldsz;
@@ -266,7 +266,7 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 		pte = walkpgdir(pgdir, (char*)a, 0);
 		if(!pte)
 			a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
-		else if((*pte & PTE_P) != 0){
+		else if((*pte & (PTE_P|PTE_ZAP)) != 0){
 			pa = PTE_ADDR(*pte);
 			if(pa == 0)
 				panic("kfree");
@@ -278,6 +278,29 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 	return newsz;
 }
 
+// Unmap the user pages from newsz up to oldsz without freeing
+// them, for a page table other CPUs may be using.  The PTEs keep
+// their addresses under PTE_ZAP, so that once tlbshootdown() has
+// run, deallocuvm() over the same range frees the pages.
+void
+unmapuvm(pde_t *pgdir, uint oldsz, uint newsz)
+{
+	pte_t *pte;
+	uint a;
+
+	if(newsz >= oldsz)
+		return;
+
+	a = PGROUNDUP(newsz);
+	for(; a  < oldsz; a += PGSIZE){
+		pte = walkpgdir(pgdir, (char*)a, 0);
+		if(!pte)
+			a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+		else if((*pte & PTE_P) != 0)
+			*pte = (*pte & ~PTE_P) | PTE_ZAP;
+	}
+}
+
 // Free a page table and all the physical memory pages
 // in the user part.
 void
@@ -310,6 +333,41 @@ clearpteu(pde_t *pgdir, char *uva)
 	*pte &= ~PTE_U;
 }
 
+// Map the n physical pages in pages[] at user address va,
+// which must be page-aligned.  The pages are not owned by
+// pgdir: unmapshared() must remove them before freevm().
+int
+mapshared(pde_t *pgdir, uint va, char **pages, int n, int perm)
+{
+	int i;
+
+	if(va % PGSIZE != 0)
+		panic("mapshared: va must be page aligned");
+	for(i = 0; i < n; i++){
+		if(mappages(pgdir, (char*)va + i*PGSIZE, PGSIZE,
+		            V2P(pages[i]), perm) < 0){
+			unmapshared(pgdir, va, i);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// Remove n pages mapped by mapshared() at va, without
+// freeing the physical memory behind them.
+void
+unmapshared(pde_t *pgdir, uint va, int n)
+{
+	pte_t *pte;
+	int i;
+
+	for(i = 0; i < n; i++){
+		if((pte = walkpgdir(pgdir, (char*)va + i*PGSIZE, 0)) == 0)
+			panic("unmapshared");
+		*pte = 0;
+	}
+}
+
 // Given a parent process's page table, create a copy
 // of it for a child.
 pde_t*
@@ -351,7 +409,7 @@ uva2ka(pde_t *pgdir, char *uva)
 	pte_t *pte;
 
 	pte = walkpgdir(pgdir, uva, 0);
-	if((*pte & PTE_P) == 0)
+	if(pte == 0 || (*pte & PTE_P) == 0)
 		return 0;
 	if((*pte & PTE_U) == 0)
 		return 0;
@@ -30,6 +30,30 @@ outw(ushort port, ushort data)
 	asm volatile("out %0,%1" : : "a" (data), "d" (port));
 }
 
+static inline ushort
+inw(ushort port)
+{
+	ushort data;
+
+	asm volatile("in %1,%0" : "=a" (data) : "d" (port));
+	return data;
+}
+
+static inline uint
+inl(ushort port)
+{
+	uint data;
+
+	asm volatile("in %1,%0" : "=a" (data) : "d" (port));
+	return data;
+}
+
+static inline void
+outl(ushort port, uint data)
+{
+	asm volatile("out %0,%1" : : "a" (data), "d" (port));
+}
+
 static inline void
 outsl(int port, const void *addr, int cnt)
 {
@@ -134,6 +158,14 @@ rcr2(void)
 	return val;
 }
 
+static inline uint
+rcr3(void)
+{
+	uint val;
+	asm volatile("movl %%cr3,%0" : "=r" (val));
+	return val;
+}
+
 static inline void
 lcr3(uint val)
 {
@@ -22,7 +22,7 @@
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = LOGSIZE+1;  // header block and data blocks, set with -l
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -153,13 +153,23 @@ main(int argc, char *argv[])
 
 	static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+	if(argc > 2 && strcmp(argv[1], "-l") == 0){
+		nlog = atoi(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
 	if(argc < 2){
-		fprintf(stderr, "Usage: mkfs fs.img files...\n");
+		fprintf(stderr, "Usage: mkfs [-l nlog] fs.img files...\n");
+		exit(1);
+	}
+	if(nlog < MAXOPBLOCKS+1 || nlog > LOGSIZE+1){
+		fprintf(stderr, "mkfs: nlog must be %d..%d\n", MAXOPBLOCKS+1, LOGSIZE+1);
 		exit(1);
 	}
 
 	assert((BSIZE % sizeof(struct dinode)) == 0);
 	assert((BSIZE % sizeof(struct dirent)) == 0);
+	assert(BSIZE % 512 == 0 && BSIZE <= 4096);
 
 	fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
 	if(fsfd < 0){
@@ -167,7 +177,6 @@ main(int argc, char *argv[])
 		exit(1);
 	}
 
-	// 1 fs block = 1 disk sector
 	nmeta = 2 + nlog + ninodeblocks + nbitmap;
 	nblocks = FSSIZE - nmeta;
 
@@ -178,6 +187,8 @@ main(int argc, char *argv[])
 	sb.logstart = xint(2);
 	sb.inodestart = xint(2+nlog);
 	sb.bmapstart = xint(2+nlog+ninodeblocks);
+	sb.magic = xint(FSMAGIC);
+	sb.bsize = xint(BSIZE);
 
 	printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
 	        nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
@@ -323,14 +334,28 @@ balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return entry i of the indirect block at sector sec,
+// allocating a block for it if it is empty.
+uint
+indirect(uint sec, uint i)
+{
+	uint a[NINDIRECT];
+
+	rsect(sec, (char*)a);
+	if(a[i] == 0){
+		a[i] = xint(freeblock++);
+		wsect(sec, (char*)a);
+	}
+	return xint(a[i]);
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
 	char *p = (char*)xp;
-	uint fbn, off, n1;
+	uint fbn, dbn, off, n1;
 	struct dinode din;
 	char buf[BSIZE];
-	uint indirect[NINDIRECT];
 	uint x;
 
 	rinode(inum, &din);
@@ -344,16 +369,18 @@ iappend(uint inum, void *xp, int n)
 				din.addrs[fbn] = xint(freeblock++);
 			}
 			x = xint(din.addrs[fbn]);
-		} else {
+		} else if(fbn < NDIRECT + NINDIRECT){
 			if(xint(din.addrs[NDIRECT]) == 0){
 				din.addrs[NDIRECT] = xint(freeblock++);
 			}
-			rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-			if(indirect[fbn - NDIRECT] == 0){
-				indirect[fbn - NDIRECT] = xint(freeblock++);
-				wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
+			x = indirect(xint(din.addrs[NDIRECT]), fbn - NDIRECT);
+		} else {
+			if(xint(din.addrs[NDIRECT+1]) == 0){
+				din.addrs[NDIRECT+1] = xint(freeblock++);
 			}
-			x = xint(indirect[fbn-NDIRECT]);
+			dbn = fbn - NDIRECT - NINDIRECT;
+			x = indirect(xint(din.addrs[NDIRECT+1]), dbn / NINDIRECT);
+			x = indirect(x, dbn % NINDIRECT);
 		}
 		n1 = min(n, (fbn + 1) * BSIZE - off);
 		rsect(x, buf);
@@ -0,0 +1,30 @@
+// Print block and inode cache statistics, optionally
+// setting the limit on the number of cached blocks first.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user.h"
+
+int
+main(int argc, char **argv)
+{
+	struct bcstat st;
+	struct icstat ist;
+	int max;
+
+	max = 0;
+	if(argc > 2 || (argc == 2 && (max = atoi(argv[1])) <= 0)){
+		fprintf(2, "usage: bcstat [maxbuf]\n");
+		exit();
+	}
+	if(bcachestat(&st, max) < 0){
+		fprintf(2, "bcstat: failed\n");
+		exit();
+	}
+	printf("buffers %d/%d hits %d misses %d evictions %d\n",
+		st.nbuf, st.maxbuf, st.hits, st.misses, st.evictions);
+	if(icachestat(&ist) == 0)
+		printf("inodes %d/%d hits %d misses %d\n",
+			ist.nref, ist.ninode, ist.hits, ist.misses);
+	exit();
+}
@@ -0,0 +1,122 @@
+// Block device throughput benchmark: writes a file, reads it
+// back sequentially with read() and then in random page order
+// through mmap(), with the block cache shrunk so that the reads
+// go to disk.  Run it on a kernel built with and without
+// VIRTIO=1 to compare the virtio and IDE drivers.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user.h"
+
+#define FILESZ (256*1024)
+#define NPAGE (FILESZ/4096)
+#define ROUNDS 4
+
+char buf[4096];
+char name[] = "blkbench.tmp";
+uint seed = 1;
+
+uint
+rand(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 16;
+}
+
+void
+report(char *what, int kb, int t)
+{
+	struct diskstat st;
+
+	diskstat(&st, -1);
+	if(t == 0)
+		t = 1;
+	printf("%s: %d KB in %d ticks, %d KB/tick, %d requests, %d sectors\n",
+		what, kb, t, kb / t, st.cmds, st.sectors);
+}
+
+void
+seqwrite(void)
+{
+	struct diskstat st;
+	int i, fd, t;
+
+	diskstat(&st, -1);
+	t = uptime();
+	if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+		printf("blkbench: cannot create %s\n", name);
+		exit();
+	}
+	memset(buf, 'b', sizeof(buf));
+	for(i = 0; i < FILESZ; i += sizeof(buf))
+		if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+			printf("blkbench: write failed\n");
+			exit();
+		}
+	close(fd);
+	report("seq write ", FILESZ/1024, uptime() - t);
+}
+
+void
+seqread(void)
+{
+	struct diskstat st;
+	int r, fd, t;
+
+	diskstat(&st, -1);
+	t = uptime();
+	for(r = 0; r < ROUNDS; r++){
+		if((fd = open(name, O_RDONLY)) < 0)
+			exit();
+		while(read(fd, buf, sizeof(buf)) > 0)
+			;
+		close(fd);
+	}
+	report("seq read  ", ROUNDS*FILESZ/1024, uptime() - t);
+}
+
+void
+randread(void)
+{
+	struct diskstat st;
+	int r, i, fd, t, sum;
+	char *p;
+
+	diskstat(&st, -1);
+	t = uptime();
+	sum = 0;
+	for(r = 0; r < ROUNDS; r++){
+		if((fd = open(name, O_RDONLY)) < 0)
+			exit();
+		p = mmap(fd, 0, FILESZ, PROT_READ, MAP_PRIVATE);
+		close(fd);
+		if(p == (char*)-1){
+			printf("blkbench: mmap failed\n");
+			exit();
+		}
+		for(i = 0; i < NPAGE; i++)
+			sum += p[(rand() % NPAGE) * 4096];
+		munmap(p, FILESZ);
+	}
+	if(sum == 0)
+		printf("blkbench: bad data\n");
+	report("rand read ", ROUNDS*FILESZ/1024, uptime() - t);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct bcstat bc;
+	int maxbuf;
+
+	bcachestat(&bc, 0);
+	maxbuf = bc.maxbuf;
+	bcachestat(&bc, 1);  // smallest cache
+	seqwrite();
+	seqread();
+	randread();
+	bcachestat(&bc, maxbuf);
+	unlink(name);
+	exit();
+}
@@ -0,0 +1,130 @@
+// Disk scheduling benchmark: several processes read their own
+// files at once, half of them sequentially with read() and half
+// in random page order through mmap(), with the block cache
+// shrunk so that the reads go to disk.  The mix runs once with
+// FIFO and once with C-LOOK ordering of the disk queue.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user.h"
+
+#define NPROC 4
+#define FILESZ (64*1024)
+#define NPAGE (FILESZ/4096)
+#define ROUNDS 4
+
+char buf[4096];
+char name[] = "dbench0";
+uint seed;
+
+uint
+rand(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 16;
+}
+
+void
+makefiles(void)
+{
+	int i, j, fd;
+
+	for(i = 0; i < NPROC; i++){
+		name[6] = '0' + i;
+		if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+			printf("diskbench: cannot create %s\n", name);
+			exit();
+		}
+		memset(buf, 'a' + i, sizeof(buf));
+		for(j = 0; j < FILESZ; j += sizeof(buf))
+			if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+				printf("diskbench: write failed\n");
+				exit();
+			}
+		close(fd);
+	}
+}
+
+void
+sequential(void)
+{
+	int fd, r;
+
+	for(r = 0; r < ROUNDS; r++){
+		if((fd = open(name, O_RDONLY)) < 0)
+			exit();
+		while(read(fd, buf, 512) > 0)
+			;
+		close(fd);
+	}
+}
+
+void
+random(void)
+{
+	int fd, r, i, sum;
+	char *p;
+
+	sum = 0;
+	for(r = 0; r < ROUNDS; r++){
+		if((fd = open(name, O_RDONLY)) < 0)
+			exit();
+		p = mmap(fd, 0, FILESZ, PROT_READ, MAP_PRIVATE);
+		close(fd);
+		if(p == (char*)-1)
+			exit();
+		for(i = 0; i < NPAGE; i++)
+			sum += p[(rand() % NPAGE) * 4096];
+		munmap(p, FILESZ);
+	}
+	if(sum == 0)
+		printf("diskbench: bad data\n");
+}
+
+void
+run(int sched)
+{
+	struct diskstat st;
+	int i, t;
+
+	diskstat(&st, sched);
+	t = uptime();
+	for(i = 0; i < NPROC; i++){
+		if(fork() == 0){
+			name[6] = '0' + i;
+			seed = i + 1;
+			if(i % 2)
+				random();
+			else
+				sequential();
+			exit();
+		}
+	}
+	for(i = 0; i < NPROC; i++)
+		wait();
+	t = uptime() - t;
+	diskstat(&st, -1);
+	printf("%s: %d ticks, %d commands, %d sectors, seek %d sectors, %d expired\n",
+		sched == DISK_FIFO ? "fifo " : "clook", t, st.cmds, st.sectors, st.seek, st.expired);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct bcstat bc;
+	int i, maxbuf;
+
+	makefiles();
+	bcachestat(&bc, 0);
+	maxbuf = bc.maxbuf;
+	bcachestat(&bc, 1);  // smallest cache
+	run(DISK_FIFO);
+	run(DISK_CLOOK);
+	bcachestat(&bc, maxbuf);
+	for(i = 0; i < NPROC; i++){
+		name[6] = '0' + i;
+		unlink(name);
+	}
+	exit();
+}
@@ -0,0 +1,88 @@
+// Test fsync() and group commit: several processes create and
+// write files at once, calling fsync() after each write, and
+// check what they read back.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user.h"
+
+#define NPROC 4
+#define NFILE 8
+#define SZ 1000
+
+char buf[SZ];
+char name[] = "fsync00";
+
+void
+fail(char *msg)
+{
+	printf("fsynctest failed: %s\n", msg);
+	exit();
+}
+
+void
+writer(int i)
+{
+	int j, fd;
+
+	name[5] = '0' + i;
+	for(j = 0; j < NFILE; j++){
+		name[6] = '0' + j;
+		if((fd = open(name, O_CREATE|O_RDWR)) < 0)
+			fail("create");
+		memset(buf, 'a' + i + j, SZ);
+		if(write(fd, buf, SZ) != SZ)
+			fail("write");
+		if(fsync(fd) < 0)
+			fail("fsync");
+		close(fd);
+	}
+}
+
+void
+check(int i)
+{
+	int j, k, fd;
+
+	name[5] = '0' + i;
+	for(j = 0; j < NFILE; j++){
+		name[6] = '0' + j;
+		if((fd = open(name, O_RDONLY)) < 0)
+			fail("open");
+		if(read(fd, buf, SZ) != SZ)
+			fail("read");
+		for(k = 0; k < SZ; k++)
+			if(buf[k] != 'a' + i + j)
+				fail("wrong data");
+		close(fd);
+		unlink(name);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i, t, p[2];
+
+	pipe(p);
+	if(fsync(p[0]) >= 0)
+		fail("fsync of a pipe");
+	close(p[0]);
+	close(p[1]);
+
+	t = uptime();
+	for(i = 0; i < NPROC; i++){
+		if(fork() == 0){
+			writer(i);
+			exit();
+		}
+	}
+	for(i = 0; i < NPROC; i++)
+		wait();
+	t = uptime() - t;
+	for(i = 0; i < NPROC; i++)
+		check(i);
+	printf("fsynctest ok: %d files in %d ticks\n", NPROC*NFILE, t);
+	exit();
+}
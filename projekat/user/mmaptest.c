@@ -0,0 +1,151 @@
+// Test mmap() and munmap() of files: private and shared
+// mappings, write-back, sharing across fork(), partial unmap.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user.h"
+
+#define NPAGE 3
+#define SZ (NPAGE*4096 - 100)  // last page is partly past EOF
+
+char buf[4096];
+
+void
+fail(char *msg)
+{
+	printf("mmaptest failed: %s\n", msg);
+	unlink("mmapfile");
+	exit();
+}
+
+void
+makefile(void)
+{
+	int fd, i, n;
+
+	if((fd = open("mmapfile", O_CREATE|O_RDWR)) < 0)
+		fail("create");
+	for(i = 0; i < SZ; i += n){
+		n = SZ - i > sizeof(buf) ? sizeof(buf) : SZ - i;
+		memset(buf, 'A' + i/4096, n);
+		if(write(fd, buf, n) != n)
+			fail("write");
+	}
+	close(fd);
+}
+
+// Check that p holds the file as written by makefile().
+void
+checkpages(char *p, char *msg)
+{
+	int i;
+
+	for(i = 0; i < NPAGE*4096; i++)
+		if(p[i] != (i < SZ ? 'A' + i/4096 : 0))
+			fail(msg);
+}
+
+void
+privatetest(void)
+{
+	int fd;
+	char *p;
+
+	printf("mmap private test\n");
+	makefile();
+	if((fd = open("mmapfile", O_RDONLY)) < 0)
+		fail("open");
+	p = mmap(fd, 0, NPAGE*4096, PROT_READ|PROT_WRITE, MAP_PRIVATE);
+	if(p == (char*)-1)
+		fail("mmap private");
+	close(fd);
+	checkpages(p, "private contents");
+	p[0] = 'x';
+	if(munmap(p, NPAGE*4096) < 0)
+		fail("munmap private");
+
+	// Private writes must not reach the file.
+	if((fd = open("mmapfile", O_RDONLY)) < 0 || read(fd, buf, 1) != 1 || buf[0] != 'A')
+		fail("private write reached file");
+	close(fd);
+	printf("mmap private test ok\n");
+}
+
+void
+sharedtest(void)
+{
+	int fd, pid;
+	char *p;
+
+	printf("mmap shared test\n");
+	if((fd = open("mmapfile", O_RDWR)) < 0)
+		fail("open");
+	p = mmap(fd, 0, NPAGE*4096, PROT_READ|PROT_WRITE, MAP_SHARED);
+	if(p == (char*)-1)
+		fail("mmap shared");
+	if(p[4096] != 'B')
+		fail("shared contents");
+
+	// The child writes through the same pages.
+	pid = fork();
+	if(pid < 0)
+		fail("fork");
+	if(pid == 0){
+		p[4096] = 'y';
+		p[SZ] = 'z';  // past EOF: must not grow the file
+		exit();
+	}
+	wait();
+	if(p[4096] != 'y')
+		fail("child write not seen");
+	if(munmap(p, NPAGE*4096) < 0)
+		fail("munmap shared");
+
+	close(fd);
+	if((fd = open("mmapfile", O_RDONLY)) < 0)
+		fail("open");
+	if(read(fd, buf, sizeof(buf)) != sizeof(buf) || read(fd, buf, sizeof(buf)) != sizeof(buf))
+		fail("read");
+	if(buf[0] != 'y' || buf[1] != 'B')
+		fail("shared write not written back");
+	close(fd);
+	printf("mmap shared test ok\n");
+}
+
+void
+unmaptest(void)
+{
+	int fd;
+	char *p;
+	struct stat st;
+
+	printf("munmap test\n");
+	if((fd = open("mmapfile", O_RDONLY)) < 0)
+		fail("open");
+	p = mmap(fd, 4096, 2*4096, PROT_READ, MAP_SHARED);
+	if(p == (char*)-1)
+		fail("mmap at offset");
+	if(p[0] != 'y' || p[4096] != 'C')
+		fail("offset contents");
+	if(munmap(p + 4096, 4096) < 0 || munmap(p, 4096) < 0)
+		fail("partial munmap");
+	if(munmap(p, 4096) == 0)
+		fail("munmap of unmapped range");
+	if(mmap(fd, 0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED) != (char*)-1)
+		fail("writable shared mapping of read-only file");
+	if(fstat(fd, &st) < 0 || st.size != SZ)
+		fail("file size changed");
+	close(fd);
+	printf("munmap test ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	privatetest();
+	sharedtest();
+	unmaptest();
+	unlink("mmapfile");
+	exit();
+}
@@ -0,0 +1,81 @@
+// Pipe throughput benchmark: a child writes TOTAL bytes into a
+// pipe in chunks of each size in turn, and the parent reads them
+// back, checks them and reports the time taken.  Then the same
+// with the pipe's buffer grown by pipesize().
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user.h"
+
+#define TOTAL (1024*1024)
+
+int sizes[] = { 100, 512, 4096, 16384 };
+char wbuf[16384];
+char rbuf[16384];
+
+void
+fail(char *msg)
+{
+	printf("pipebench failed: %s\n", msg);
+	exit();
+}
+
+void
+run(int sz, int psz)
+{
+	int p[2], i, n, tot, t;
+
+	if(pipe(p) < 0)
+		fail("pipe");
+	if(psz && pipesize(p[1], psz) != psz)
+		fail("pipesize");
+	psz = pipesize(p[1], 0);
+	t = uptime();
+	if(fork() == 0){
+		close(p[0]);
+		for(tot = 0; tot < TOTAL; tot += sz){
+			for(i = 0; i < sz; i++)
+				wbuf[i] = (tot + i) % 251;
+			if(write(p[1], wbuf, sz) != sz)
+				fail("write");
+		}
+		exit();
+	}
+	close(p[1]);
+	tot = 0;
+	while((n = read(p[0], rbuf, sizeof(rbuf))) > 0){
+		for(i = 0; i < n; i++)
+			if(rbuf[i] != (char)((tot + i) % 251))
+				fail("wrong data");
+		tot += n;
+	}
+	close(p[0]);
+	wait();
+	if(tot != (TOTAL + sz - 1) / sz * sz)
+		fail("short read");
+	printf("%d-byte writes, %d-byte pipe: %d KB in %d ticks\n",
+		sz, psz, tot/1024, uptime() - t);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i, p[2];
+
+	pipe(p);
+	if(pipesize(p[0], 0) != 4096 || pipesize(p[0], 5000) != 8192)
+		fail("pipesize rounding");
+	write(p[1], "abc", 3);
+	if(pipesize(p[0], 1) != 4096 || read(p[0], rbuf, 3) != 3 ||
+	   rbuf[0] != 'a' || rbuf[2] != 'c')
+		fail("pipesize keeps data");
+	close(p[0]);
+	close(p[1]);
+
+	for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+		run(sizes[i], 0);
+	for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+		run(sizes[i], 65536);
+	printf("pipebench ok\n");
+	exit();
+}
@@ -0,0 +1,111 @@
+// Test poll(): one process waits on several pipes whose writers
+// write at different times, and on files, ttys, closed fds and
+// timeouts.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user.h"
+
+#define NPIPE 3
+
+void
+fail(char *msg)
+{
+	printf("polltest failed: %s\n", msg);
+	exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct pollfd pfd[NPIPE+1];
+	int p[NPIPE][2], i, n, got, t;
+	char c;
+
+	// Each child writes its number after a while, then exits.
+	for(i = 0; i < NPIPE; i++){
+		pipe(p[i]);
+		if(fork() == 0){
+			sleep(5 + 10*i);
+			c = '0' + i;
+			write(p[i][1], &c, 1);
+			exit();
+		}
+		close(p[i][1]);
+		pfd[i].fd = p[i][0];
+		pfd[i].events = POLLIN;
+	}
+
+	got = 0;
+	while(got < NPIPE){
+		if((n = poll(pfd, NPIPE, -1)) <= 0)
+			fail("poll");
+		for(i = 0; i < NPIPE; i++){
+			if(pfd[i].revents & POLLIN){
+				if(read(pfd[i].fd, &c, 1) != 1 || c != '0' + i)
+					fail("wrong data");
+				got++;
+			}
+			if(pfd[i].revents & POLLHUP){
+				close(pfd[i].fd);
+				pfd[i].fd = -1;
+			}
+		}
+	}
+	for(i = 0; i < NPIPE; i++){
+		wait();
+		if(pfd[i].fd >= 0)
+			close(pfd[i].fd);
+	}
+
+	// Timeout on a pipe nobody writes to.
+	pipe(p[0]);
+	pfd[0].fd = p[0][0];
+	pfd[0].events = POLLIN;
+	t = uptime();
+	if(poll(pfd, 1, 3) != 0 || uptime() - t < 3)
+		fail("timeout");
+
+	// A pipe with room is writable; a file is always ready; a
+	// closed fd is reported as such.
+	pfd[0].fd = p[0][1];
+	pfd[0].events = POLLOUT;
+	pfd[1].fd = open("README", O_RDONLY);
+	pfd[1].events = POLLIN;
+	pfd[2].fd = 15;
+	pfd[2].events = POLLIN;
+	if(poll(pfd, 3, 0) != 3 || pfd[0].revents != POLLOUT ||
+	   pfd[1].revents != POLLIN || pfd[2].revents != POLLNVAL)
+		fail("ready states");
+	close(pfd[1].fd);
+
+	// A pipe without readers is an error for its writer.
+	close(p[0][0]);
+	if(poll(pfd, 1, 0) != 1 || !(pfd[0].revents & POLLERR))
+		fail("no readers");
+	close(p[0][1]);
+
+	// Every tty is writable.  A console device with no tty
+	// behind it is an error, and can't be read.
+	mknod("polltty", 1, 7);
+	pfd[0].fd = open("/dev/tty1", O_RDWR);
+	pfd[1].fd = open("/dev/tty6", O_RDWR);
+	pfd[2].fd = open("polltty", O_RDWR);
+	for(i = 0; i < 3; i++){
+		if(pfd[i].fd < 0)
+			fail("open tty");
+		pfd[i].events = POLLOUT;
+	}
+	if(poll(pfd, 3, 0) != 3 || !(pfd[0].revents & POLLOUT) ||
+	   !(pfd[1].revents & POLLOUT) || pfd[2].revents != POLLERR)
+		fail("ttys");
+	if(read(pfd[2].fd, &c, 1) != -1)
+		fail("read from no tty");
+	for(i = 0; i < 3; i++)
+		close(pfd[i].fd);
+	unlink("polltty");
+
+	printf("polltest ok\n");
+	exit();
+}
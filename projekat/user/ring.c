@@ -0,0 +1,196 @@
+// Message rings over shared memory.
+//
+// A ring is a shared memory object holding a bounded queue of
+// fixed-size slots, mapped into every process that opens it by
+// name.  Any number of processes can send and receive; a message
+// is copied straight into a slot by the sender and straight out
+// of it by the receiver, with no system calls while the ring is
+// neither empty nor full.
+//
+// Each slot carries a sequence number (Vyukov's bounded queue):
+// a sender may fill the slot at position pos once its sequence
+// is pos, and a receiver may empty it once its sequence is pos+1.
+// Positions are claimed with compare-and-swap on tail and head.
+// Sequences are stored relative to the slot index, so the zeroed
+// pages handed out by shm_trunc() are already a valid empty ring.
+//
+// A process that finds the ring empty (full) announces itself in
+// recvwait (sendwait), looks once more, and sleeps with futex_wait()
+// on recvev (sendev); the other side only bumps the event word and
+// calls futex_wake() when it sees such a waiter.
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user.h"
+
+struct ringslot {
+	uint seq;               // sequence number, minus slot index
+	uint len;               // length of message in data
+	char data[RINGMSG];
+};
+
+struct ringhdr {
+	uint head;              // next position to receive from
+	char pad0[60];
+	uint tail;              // next position to send to
+	char pad1[60];
+	uint recvev;            // bumped when a waiting receiver may proceed
+	uint recvwait;          // number of receivers waiting on recvev
+	uint sendev;            // bumped when a waiting sender may proceed
+	uint sendwait;          // number of senders waiting on sendev
+	char pad2[48];
+	struct ringslot slot[];
+};
+
+// Open the ring called name, creating it with room for about
+// size bytes if it doesn't exist yet.  Returns 0 or -1.
+int
+ring_open(struct ring *r, char *name, int size)
+{
+	int n;
+	void *p;
+
+	if((r->fd = shm_open(name)) < 0)
+		return -1;
+	if((size = shm_trunc(r->fd, size)) < 0 ||
+	   shm_map(r->fd, &p, O_RDWR) < 0){
+		shm_close(r->fd);
+		return -1;
+	}
+	r->hdr = p;
+
+	// Use the largest power of two number of slots that fits.
+	n = (size - (int)sizeof(struct ringhdr)) / (int)sizeof(struct ringslot);
+	for(r->mask = 1; r->mask*2 <= n; r->mask *= 2)
+		;
+	if(n < 1){
+		shm_close(r->fd);
+		return -1;
+	}
+	r->mask--;
+	return 0;
+}
+
+void
+ring_close(struct ring *r)
+{
+	shm_close(r->fd);
+	r->hdr = 0;
+}
+
+// Let a waiter on ev proceed, if there is one.
+static void
+ringwake(uint *ev, uint *waiters)
+{
+	__sync_synchronize();
+	if(*waiters){
+		__sync_fetch_and_add(ev, 1);
+		futex_wake((int*)ev, 1);
+	}
+}
+
+// Try to send n bytes from buf.  Returns n, or -1 if the ring is full.
+int
+ring_trysend(struct ring *r, void *buf, int n)
+{
+	struct ringhdr *h = r->hdr;
+	struct ringslot *s;
+	uint pos, seq;
+
+	if(n < 0 || n > RINGMSG)
+		return -1;
+	for(;;){
+		pos = h->tail;
+		s = &h->slot[pos & r->mask];
+		seq = s->seq + (pos & r->mask);
+		if(seq == pos){
+			if(__sync_bool_compare_and_swap(&h->tail, pos, pos+1))
+				break;
+		} else if((int)(seq - pos) < 0)
+			return -1;  // slot not yet emptied: full
+	}
+
+	memmove(s->data, buf, n);
+	s->len = n;
+	__sync_synchronize();
+	s->seq = pos + 1 - (pos & r->mask);
+	ringwake(&h->recvev, &h->recvwait);
+	return n;
+}
+
+// Try to receive a message into buf, which has room for max
+// bytes.  Returns the message length, or -1 if the ring is empty.
+int
+ring_tryrecv(struct ring *r, void *buf, int max)
+{
+	struct ringhdr *h = r->hdr;
+	struct ringslot *s;
+	uint pos, seq;
+	int n;
+
+	for(;;){
+		pos = h->head;
+		s = &h->slot[pos & r->mask];
+		seq = s->seq + (pos & r->mask);
+		if(seq == pos + 1){
+			if(__sync_bool_compare_and_swap(&h->head, pos, pos+1))
+				break;
+		} else if((int)(seq - (pos + 1)) < 0)
+			return -1;  // slot not yet filled: empty
+	}
+
+	n = s->len;
+	if(n > max)
+		n = max;
+	memmove(buf, s->data, n);
+	__sync_synchronize();
+	s->seq = pos + r->mask + 1 - (pos & r->mask);
+	ringwake(&h->sendev, &h->sendwait);
+	return n;
+}
+
+// Send n bytes from buf, sleeping while the ring is full.
+int
+ring_send(struct ring *r, void *buf, int n)
+{
+	struct ringhdr *h = r->hdr;
+	uint ev;
+	int cc;
+
+	if(n < 0 || n > RINGMSG)
+		return -1;
+	for(;;){
+		ev = h->sendev;
+		if((cc = ring_trysend(r, buf, n)) >= 0)
+			return cc;
+		// Register as a waiter, then look again: a receiver
+		// that empties a slot from now on will bump sendev.
+		__sync_fetch_and_add(&h->sendwait, 1);
+		if((cc = ring_trysend(r, buf, n)) < 0)
+			futex_wait((int*)&h->sendev, ev);
+		__sync_fetch_and_sub(&h->sendwait, 1);
+		if(cc >= 0)
+			return cc;
+	}
+}
+
+// Receive a message into buf, sleeping while the ring is empty.
+int
+ring_recv(struct ring *r, void *buf, int max)
+{
+	struct ringhdr *h = r->hdr;
+	uint ev;
+	int cc;
+
+	for(;;){
+		ev = h->recvev;
+		if((cc = ring_tryrecv(r, buf, max)) >= 0)
+			return cc;
+		__sync_fetch_and_add(&h->recvwait, 1);
+		if((cc = ring_tryrecv(r, buf, max)) < 0)
+			futex_wait((int*)&h->recvev, ev);
+		__sync_fetch_and_sub(&h->recvwait, 1);
+		if(cc >= 0)
+			return cc;
+	}
+}
@@ -0,0 +1,90 @@
+// Test message rings: one sender and one receiver, then
+// several senders feeding one receiver through a small ring
+// so that both sides have to block.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user.h"
+
+#define N 2000
+#define NSENDERS 3
+
+int
+spsc(void)
+{
+	struct ring r;
+	int i, v, pid;
+
+	printf("ring spsc test\n");
+	if(ring_open(&r, "/ringtest1", 4096) < 0){
+		printf("ring_open failed\n");
+		return -1;
+	}
+	pid = fork();
+	if(pid < 0){
+		printf("fork failed\n");
+		return -1;
+	}
+	if(pid == 0){
+		for(i = 0; i < N; i++)
+			ring_send(&r, &i, sizeof(i));
+		ring_close(&r);
+		exit();
+	}
+	for(i = 0; i < N; i++){
+		if(ring_recv(&r, &v, sizeof(v)) != sizeof(v) || v != i){
+			printf("ring spsc: got %d, expected %d\n", v, i);
+			return -1;
+		}
+	}
+	wait();
+	ring_close(&r);
+	printf("ring spsc test ok\n");
+	return 0;
+}
+
+int
+mpsc(void)
+{
+	struct ring r;
+	int i, s, msg[2], next[NSENDERS];
+
+	printf("ring mpsc test\n");
+	if(ring_open(&r, "/ringtest2", 4096) < 0){
+		printf("ring_open failed\n");
+		return -1;
+	}
+	for(s = 0; s < NSENDERS; s++){
+		next[s] = 0;
+		if(fork() == 0){
+			msg[0] = s;
+			for(i = 0; i < N; i++){
+				msg[1] = i;
+				ring_send(&r, msg, sizeof(msg));
+			}
+			ring_close(&r);
+			exit();
+		}
+	}
+	for(i = 0; i < NSENDERS*N; i++){
+		if(ring_recv(&r, msg, sizeof(msg)) != sizeof(msg) ||
+		   msg[0] < 0 || msg[0] >= NSENDERS || msg[1] != next[msg[0]]){
+			printf("ring mpsc: bad message %d %d\n", msg[0], msg[1]);
+			return -1;
+		}
+		next[msg[0]]++;
+	}
+	for(s = 0; s < NSENDERS; s++)
+		wait();
+	ring_close(&r);
+	printf("ring mpsc test ok\n");
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	if(spsc() == 0)
+		mpsc();
+	exit();
+}
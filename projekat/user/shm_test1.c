@@ -10,7 +10,7 @@ int test1(void)
 	{
 		wait();
 		int fd = shm_open("/test1");
-		int size = shm_trunc(fd, 400);
+		shm_trunc(fd, 400);
 		int *p;
 		shm_map(fd, (void **) &p, O_RDWR);
 		sleep(50);
@@ -29,7 +29,7 @@ int test1(void)
 	if(fork())
 	{
 		int fd = shm_open("/test1");
-		int size = shm_trunc(fd, 400);
+		shm_trunc(fd, 400);
 		int *p;
 		shm_map(fd, (void **) &p, O_RDWR);
 		p[0] = 42;
@@ -39,7 +39,7 @@ int test1(void)
 	else
 	{
 		int fd = shm_open("/test1");
-		int size = shm_trunc(fd, 400);
+		shm_trunc(fd, 400);
 		int *p;
 		shm_map(fd, (void **) &p, O_RDWR);
 		p[1] = 42;
@@ -53,7 +53,7 @@ int test2(void)
 {
 	printf("\nstarting test 2\n");
 	int fd = shm_open("/test2");
-	int size = shm_trunc(fd, 400);
+	shm_trunc(fd, 400);
 	int *p;
 	shm_map(fd, (void **) &p, O_RDWR);
 	if(fork())
@@ -87,10 +87,10 @@ int test3(void)
 	printf("\nstarting test 3\n");
 	int fd = shm_open("/test3");
 	int pid;
-	int size = shm_trunc(fd, 400);
+	shm_trunc(fd, 400);
 	int *p;
 	shm_map(fd, (void **) &p, O_RDONLY);
-	if(pid = fork())
+	if((pid = fork()))
 	{
 		wait();
 		printf("Test 3 OK (if trap 14 was triggered before this by proces with pid: %d)\n", pid);
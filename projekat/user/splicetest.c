@@ -0,0 +1,80 @@
+// Test splice() and sendfile(): move a file through a pipe into
+// another file, and read parts of it at given offsets.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user.h"
+
+#define SZ 10000
+
+char buf[SZ];
+
+void
+fail(char *msg)
+{
+	printf("splicetest failed: %s\n", msg);
+	exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+	int fd, fd1, p[2], i, n;
+	uint off;
+
+	for(i = 0; i < SZ; i++)
+		buf[i] = i % 199;
+	if((fd = open("splice.a", O_CREATE|O_RDWR)) < 0)
+		fail("create");
+	if(write(fd, buf, SZ) != SZ)
+		fail("write");
+	close(fd);
+
+	// File to pipe, in a child, and pipe to file.
+	pipe(p);
+	if(fork() == 0){
+		close(p[0]);
+		fd = open("splice.a", O_RDONLY);
+		if(splice(fd, p[1], SZ + 100) != SZ)
+			fail("splice to pipe");
+		if(splice(fd, p[1], 100) != 0)
+			fail("splice at end of file");
+		exit();
+	}
+	close(p[1]);
+	if((fd1 = open("splice.b", O_CREATE|O_RDWR)) < 0)
+		fail("create");
+	for(i = 0; i < SZ; i += n)
+		if((n = splice(p[0], fd1, SZ - i)) <= 0)
+			fail("splice from pipe");
+	close(p[0]);
+	wait();
+	close(fd1);
+
+	fd1 = open("splice.b", O_RDONLY);
+	memset(buf, 0, SZ);
+	if(read(fd1, buf, SZ) != SZ)
+		fail("read");
+	for(i = 0; i < SZ; i++)
+		if(buf[i] != i % 199)
+			fail("wrong data");
+
+	// sendfile at an offset leaves the file offset alone.
+	pipe(p);
+	off = 5000;
+	if(sendfile(p[1], fd1, &off, 100) != 100 || off != 5100)
+		fail("sendfile");
+	if(read(p[0], buf, 100) != 100 || buf[0] != 5000 % 199)
+		fail("sendfile data");
+	if(sendfile(p[1], p[0], &off, 1) >= 0)
+		fail("sendfile from a pipe");
+	close(p[0]);
+	close(p[1]);
+	close(fd1);
+
+	unlink("splice.a");
+	unlink("splice.b");
+	printf("splicetest ok\n");
+	exit();
+}
@@ -0,0 +1,128 @@
+// Test futex-based mutexes, condition variables and
+// semaphores shared between processes through shm.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user.h"
+
+#define NCHILD 4
+#define N 1000
+
+struct shared {
+	struct mutex m;
+	struct cond c;
+	struct sem ping, pong;
+	int counter;
+	int ready;
+};
+
+struct shared *sh;
+
+void
+mutextest(void)
+{
+	int i, j, v;
+
+	printf("mutex test\n");
+	for(i = 0; i < NCHILD; i++){
+		if(fork() == 0){
+			for(j = 0; j < N; j++){
+				mutex_lock(&sh->m);
+				v = sh->counter;
+				if(j % 100 == 0)
+					sleep(1);  // get preempted holding the lock
+				sh->counter = v + 1;
+				mutex_unlock(&sh->m);
+			}
+			exit();
+		}
+	}
+	for(i = 0; i < NCHILD; i++)
+		wait();
+	if(sh->counter != NCHILD*N){
+		printf("mutex test failed: counter %d\n", sh->counter);
+		exit();
+	}
+	printf("mutex test ok\n");
+}
+
+void
+semtest(void)
+{
+	int i;
+
+	printf("sem test\n");
+	sem_init(&sh->ping, 0);
+	sem_init(&sh->pong, 0);
+	sh->counter = 0;
+	if(fork() == 0){
+		for(i = 0; i < N; i++){
+			sem_wait(&sh->ping);
+			sh->counter++;
+			sem_post(&sh->pong);
+		}
+		exit();
+	}
+	for(i = 0; i < N; i++){
+		sem_post(&sh->ping);
+		sem_wait(&sh->pong);
+		if(sh->counter != i+1){
+			printf("sem test failed: counter %d, expected %d\n", sh->counter, i+1);
+			exit();
+		}
+	}
+	wait();
+	printf("sem test ok\n");
+}
+
+void
+condtest(void)
+{
+	int i;
+
+	printf("cond test\n");
+	sh->ready = 0;
+	for(i = 0; i < NCHILD; i++){
+		if(fork() == 0){
+			mutex_lock(&sh->m);
+			while(!sh->ready)
+				cond_wait(&sh->c, &sh->m);
+			sh->ready++;
+			mutex_unlock(&sh->m);
+			exit();
+		}
+	}
+	sleep(10);
+	mutex_lock(&sh->m);
+	sh->ready = 1;
+	cond_broadcast(&sh->c);
+	mutex_unlock(&sh->m);
+	for(i = 0; i < NCHILD; i++)
+		wait();
+	if(sh->ready != NCHILD+1){
+		printf("cond test failed: ready %d\n", sh->ready);
+		exit();
+	}
+	printf("cond test ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	int fd;
+
+	if((fd = shm_open("/synctest")) < 0 || shm_trunc(fd, sizeof(*sh)) < 0 ||
+	   shm_map(fd, (void**)&sh, O_RDWR) < 0){
+		printf("synctest: shm failed\n");
+		exit();
+	}
+	memset(sh, 0, sizeof(*sh));
+
+	mutextest();
+	semtest();
+	condtest();
+
+	shm_close(fd);
+	exit();
+}
@@ -0,0 +1,155 @@
+// Test clone() and join(): threads share memory, sbrk()
+// from one thread is visible in the others, they share open
+// files and the current directory, and exit() of the main
+// thread takes the other threads along.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user.h"
+
+#define NTHREAD 4
+#define N 100000
+
+struct mutex m;
+int counter;
+char *volatile grown;
+volatile int openfd;
+
+void
+adder(void *arg)
+{
+	int i, local;
+
+	local = 0;
+	for(i = 0; i < N; i++)
+		local++;
+	mutex_lock(&m);
+	counter += local + (int)arg;
+	mutex_unlock(&m);
+}
+
+void
+sumtest(void)
+{
+	int i;
+
+	printf("thread sum test\n");
+	counter = 0;
+	for(i = 0; i < NTHREAD; i++){
+		if(thread_create(adder, (void*)i) < 0){
+			printf("thread_create failed\n");
+			exit();
+		}
+	}
+	for(i = 0; i < NTHREAD; i++){
+		if(thread_join() < 0){
+			printf("thread_join failed\n");
+			exit();
+		}
+	}
+	if(thread_join() != -1){
+		printf("thread_join: too many threads\n");
+		exit();
+	}
+	if(counter != NTHREAD*N + NTHREAD*(NTHREAD-1)/2){
+		printf("thread sum test failed: counter %d\n", counter);
+		exit();
+	}
+	printf("thread sum test ok\n");
+}
+
+void
+grower(void *arg)
+{
+	char *p;
+
+	if((p = sbrk(4096)) == (char*)-1)
+		exit();
+	p[0] = 'x';
+	grown = p;
+}
+
+void
+sbrktest(void)
+{
+	printf("thread sbrk test\n");
+	grown = 0;
+	if(thread_create(grower, 0) < 0 || thread_join() < 0){
+		printf("thread sbrk test failed\n");
+		exit();
+	}
+	if(grown == 0 || grown[0] != 'x' || sbrk(0) < grown + 4096){
+		printf("thread sbrk test failed\n");
+		exit();
+	}
+	printf("thread sbrk test ok\n");
+}
+
+void
+opener(void *arg)
+{
+	openfd = open("thrfile", O_CREATE|O_RDWR);
+	chdir("thrdir");
+}
+
+void
+filetest(void)
+{
+	int fd;
+
+	printf("thread file test\n");
+	mkdir("thrdir");
+	if(thread_create(opener, 0) < 0 || thread_join() < 0)
+		goto bad;
+	// The thread's fd and directory are the process's.
+	if(openfd < 0 || write(openfd, "x", 1) != 1 || close(openfd) < 0)
+		goto bad;
+	if((fd = open("../thrfile", O_RDONLY)) < 0)
+		goto bad;
+	close(fd);
+	chdir("..");
+	unlink("thrfile");
+	unlink("thrdir");
+	printf("thread file test ok\n");
+	return;
+bad:
+	printf("thread file test failed\n");
+	exit();
+}
+
+void
+spinner(void *arg)
+{
+	for(;;)
+		;
+}
+
+void
+exittest(void)
+{
+	int i, pid;
+
+	printf("thread exit test\n");
+	pid = fork();
+	if(pid == 0){
+		for(i = 0; i < NTHREAD; i++)
+			thread_create(spinner, 0);
+		exit();
+	}
+	if(pid < 0 || wait() != pid){
+		printf("thread exit test failed\n");
+		exit();
+	}
+	printf("thread exit test ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	sumtest();
+	sbrktest();
+	filetest();
+	exittest();
+	exit();
+}
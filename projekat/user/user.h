@@ -1,5 +1,9 @@
 struct stat;
 struct rtcdate;
+struct bcstat;
+struct diskstat;
+struct icstat;
+struct pollfd;
 
 // system calls
 int fork(void);
@@ -23,6 +27,20 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int futex_wait(int*, int);
+int futex_wake(int*, int);
+int clone(void(*)(void*), void*, void*);
+int join(void**);
+void* mmap(int, int, int, int, int);
+int munmap(void*, int);
+int bcachestat(struct bcstat*, int);
+int diskstat(struct diskstat*, int);
+int fsync(int);
+int icachestat(struct icstat*);
+int pipesize(int, int);
+int splice(int, int, int);
+int sendfile(int, int, uint*, int);
+int poll(struct pollfd*, int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -41,8 +59,57 @@ void* malloc(uint);
 void free(void*);
 int atoi(const char*);
 
+// usync.c
+struct mutex {
+	uint v;
+};
+struct cond {
+	uint seq;
+};
+struct sem {
+	uint count;
+	uint waiters;
+};
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+int mutex_trylock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+void sem_init(struct sem*, int);
+void sem_wait(struct sem*);
+int sem_trywait(struct sem*);
+void sem_post(struct sem*);
+
+// uthread.c
+int thread_create(void(*)(void*), void*);
+int thread_join(void);
+
+// ring.c
+#define RINGMSG 56  // maximum size of a ring message
+struct ringhdr;
+struct ring {
+	int fd;               // shared memory descriptor
+	uint mask;            // number of slots - 1
+	struct ringhdr *hdr;  // the shared ring
+};
+int ring_open(struct ring*, char*, int);
+void ring_close(struct ring*);
+int ring_send(struct ring*, void*, int);
+int ring_recv(struct ring*, void*, int);
+int ring_trysend(struct ring*, void*, int);
+int ring_tryrecv(struct ring*, void*, int);
+
 // colour functions
 void rstclr(void);
 void setfg(char*);
 void setbg(char*);
 void sethex(char*);
+
+// shared memory
+int shm_open(char*);
+int shm_trunc(int, int);
+int shm_map(int, void**, int);
+int shm_close(int);
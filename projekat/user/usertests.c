@@ -8,6 +8,10 @@
 #include "kernel/traps.h"
 #include "kernel/memlayout.h"
 
+// Blocks in the big file of writetest1(); into the second block
+// under the doubly-indirect one.
+#define BIGFILE (NDIRECT + 2*NINDIRECT + 2)
+
 char buf[8192];
 char name[3];
 char *echoargv[] = { "echo", "ALL", "TESTS", "PASSED", 0 };
@@ -196,9 +200,9 @@ writetest1(void)
 		exit();
 	}
 
-	for(i = 0; i < MAXFILE; i++){
+	for(i = 0; i < BIGFILE; i++){
 		((int*)buf)[0] = i;
-		if(write(fd, buf, 512) != 512){
+		if(write(fd, buf, BSIZE) != BSIZE){
 			printf("error: write big file failed\n", i);
 			exit();
 		}
@@ -214,14 +218,14 @@ writetest1(void)
 
 	n = 0;
 	for(;;){
-		i = read(fd, buf, 512);
+		i = read(fd, buf, BSIZE);
 		if(i == 0){
-			if(n == MAXFILE - 1){
+			if(n != BIGFILE){
 				printf("read only %d blocks from big", n);
 				exit();
 			}
 			break;
-		} else if(i != 512){
+		} else if(i != BSIZE){
 			printf("read failed %d\n", i);
 			exit();
 		}
@@ -1347,7 +1351,7 @@ iref(void)
 
 	printf("empty file name\n");
 
-	// the 50 is NINODE
+	// the 50 is NINODE, the smallest inode cache
 	for(i = 0; i < 50 + 1; i++){
 		if(mkdir("irefd") != 0){
 			printf("mkdir irefd failed\n");
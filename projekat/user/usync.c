@@ -0,0 +1,121 @@
+// Mutexes, condition variables and semaphores built on futexes.
+// They only enter the kernel to sleep or to wake a sleeper, and
+// work across processes when placed in shared memory.  A zeroed
+// object is an unlocked mutex, a condition variable, or a
+// semaphore with count 0.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user.h"
+
+// Mutex states: 0 unlocked, 1 locked, 2 locked with waiters
+// (Drepper, "Futexes Are Tricky").
+void
+mutex_init(struct mutex *m)
+{
+	m->v = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+	uint c;
+
+	if((c = __sync_val_compare_and_swap(&m->v, 0, 1)) == 0)
+		return;
+	if(c != 2)
+		c = __sync_lock_test_and_set(&m->v, 2);
+	while(c != 0){
+		futex_wait((int*)&m->v, 2);
+		c = __sync_lock_test_and_set(&m->v, 2);
+	}
+}
+
+// Returns 1 if the mutex was taken, 0 if it is held.
+int
+mutex_trylock(struct mutex *m)
+{
+	return __sync_bool_compare_and_swap(&m->v, 0, 1);
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+	if(__sync_fetch_and_sub(&m->v, 1) != 1){
+		m->v = 0;
+		futex_wake((int*)&m->v, 1);
+	}
+}
+
+void
+cond_init(struct cond *c)
+{
+	c->seq = 0;
+}
+
+// Atomically release m and wait for a signal, then reacquire m.
+// Wakeups may be spurious, so callers recheck their condition.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+	uint seq;
+
+	seq = c->seq;
+	mutex_unlock(m);
+	futex_wait((int*)&c->seq, seq);
+	// Other processes may be waiting for m as well,
+	// so take it in the contended state.
+	while(__sync_lock_test_and_set(&m->v, 2) != 0)
+		futex_wait((int*)&m->v, 2);
+}
+
+void
+cond_signal(struct cond *c)
+{
+	__sync_fetch_and_add(&c->seq, 1);
+	futex_wake((int*)&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+	__sync_fetch_and_add(&c->seq, 1);
+	futex_wake((int*)&c->seq, NPROC);
+}
+
+void
+sem_init(struct sem *s, int count)
+{
+	s->count = count;
+	s->waiters = 0;
+}
+
+// Returns 1 if the count was taken, 0 if it is 0.
+int
+sem_trywait(struct sem *s)
+{
+	uint v;
+
+	while((v = s->count) > 0)
+		if(__sync_bool_compare_and_swap(&s->count, v, v-1))
+			return 1;
+	return 0;
+}
+
+void
+sem_wait(struct sem *s)
+{
+	while(!sem_trywait(s)){
+		__sync_fetch_and_add(&s->waiters, 1);
+		futex_wait((int*)&s->count, 0);
+		__sync_fetch_and_sub(&s->waiters, 1);
+	}
+}
+
+void
+sem_post(struct sem *s)
+{
+	__sync_fetch_and_add(&s->count, 1);
+	if(s->waiters)
+		futex_wake((int*)&s->count, 1);
+}
@@ -0,0 +1,60 @@
+// User threads on top of clone() and join().
+//
+// thread_create() runs fn(arg) in a new thread that shares the
+// caller's memory, on a stack taken from malloc().  A thread
+// ends by returning from fn or by calling exit(); thread_join()
+// waits for any thread to end and frees its stack.  malloc() is
+// not thread-safe, so threads should be created and joined by
+// one thread only.
+
+#include "kernel/types.h"
+#include "kernel/mmu.h"
+#include "user.h"
+
+#define TSTACK PGSIZE  // size of a thread's stack
+
+// Kept at the bottom of each thread's stack.
+struct tstart {
+	void (*fn)(void*);
+	void *arg;
+};
+
+static void
+tstart(void *a)
+{
+	struct tstart *ts = a;
+
+	ts->fn(ts->arg);
+	exit();
+}
+
+// Start fn(arg) in a new thread.  Returns its pid, or -1.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+	char *stack;
+	struct tstart *ts;
+	int pid;
+
+	if((stack = malloc(TSTACK)) == 0)
+		return -1;
+	ts = (struct tstart*)stack;
+	ts->fn = fn;
+	ts->arg = arg;
+	if((pid = clone(tstart, stack + TSTACK, ts)) < 0)
+		free(stack);
+	return pid;
+}
+
+// Wait for a thread to exit.  Returns its pid, or -1
+// if there are no other threads.
+int
+thread_join(void)
+{
+	void *top;
+	int pid;
+
+	if((pid = join(&top)) >= 0)
+		free((char*)top - TSTACK);
+	return pid;
+}